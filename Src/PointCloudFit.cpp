@@ -1,4 +1,5 @@
 #include "PointCloudFit.h"
+#include "PointCloudFitUtil.h"
 
 #include <QSettings> 
 
@@ -86,6 +87,7 @@ int _GetObjCode(_PtType type)
 
 PCFit::PCFit(const int nThread)
 	: m_GEOObjSet(0)
+	, m_gcoNeighbors(0)
 	, m_refa(1.0)
 {
 	printLogo();
@@ -94,6 +96,7 @@ PCFit::PCFit(const int nThread)
 }
 PCFit::PCFit(const char *plyFilePath, const int nThread)
 	: m_GEOObjSet(0)
+	, m_gcoNeighbors(0)
 	, m_refa(1.0)
 {
 	printLogo();
@@ -107,6 +110,10 @@ PCFit::~PCFit()
 		delete m_GEOObjSet;
         m_GEOObjSet = 0;
 	}
+	if (m_gcoNeighbors) {
+		delete m_gcoNeighbors;
+		m_gcoNeighbors = 0;
+	}
 }
 
 
@@ -137,21 +144,26 @@ void PCFit::printParams()
         " | [DeNoise_GrowNeighbors       ]:       < %000008d >   |\n"
         " | [DeNoise_DisRatioOfOutlier   ]:       < %0008.3f >   |\n"
 		" | [Precision_HT                ]:       < %0008.3f >   |\n"
+        " | [Precision_HTPeaks           ]:       < %000008d >   |\n"
+        " | [Precision_HTNormAng         ]:       < %0008.3f >   |\n"
+        " | [Precision_HTSpace           ]:       < %000008d >   |\n"
+        " | [Precision_HTMaxMB           ]:       < %000008d >   |\n"
         " | [Threshold_MaxModelNumPre    ]:       < %000008d >   |\n"
         " | [Threshold_MaxModelNum       ]:       < %000008d >   |\n"
 		" | [Threshold_NPtsPlane         ]:       < %0008.3f >   |\n"
         " | [Threshold_NPtsCylinder      ]:       < %0008.3f >   |\n"
 		" | [Threshold_DisToSurface      ]:       < %0008.3f >   |\n"
 		" | [Threshold_AngToSurface      ]:       < %0008.3f >   |\n"
+        " | [Threshold_CylinderWarmStart ]:       < %0008.3f >   |\n"
 		" | [Threshold_PRAng             ]:       < %0008.3f >   |\n"
 		" | [Threshold_PRDis             ]:       < %0008.3f >   |\n"
         " | [Threshold_PRIoU             ]:       < %0008.3f >   |\n"		
 		" +------------------------------------------------------+\n",
 		Threshold_NPts, /*RefA_Ratio,*/
 		DeNoise_MaxIteration, DeNoise_KNNNeighbors, DeNoise_GrowNeighbors, DeNoise_DisRatioOfOutlier,
-		Precision_HT, Threshold_MaxModelNumPre, Threshold_MaxModelNum,
+		Precision_HT, Precision_HTPeaks, Precision_HTNormAng, Precision_HTSpace, Precision_HTMaxMB, Threshold_MaxModelNumPre, Threshold_MaxModelNum,
         Threshold_NPtsPlane, Threshold_NPtsCylinder,
-		Threshold_DisToSurface, Threshold_AngToSurface, 
+		Threshold_DisToSurface, Threshold_AngToSurface, Threshold_CylinderWarmStart,
 		Threshold_PRAng, Threshold_PRDis, Threshold_PRIoU);
 }
 
@@ -180,12 +192,17 @@ void PCFit::initMParams(const char *iniFile)
     DeNoise_DisRatioOfOutlier = 0.1;
 
     Precision_HT             = 0.01;
+    Precision_HTPeaks        = 1;
+    Precision_HTNormAng      = 0.0;
+    Precision_HTSpace        = 0;
+    Precision_HTMaxMB        = 2048;
     Threshold_MaxModelNumPre = 10;
     Threshold_MaxModelNum    = 30;
     Threshold_NPtsPlane      = 0.05;
     Threshold_NPtsCylinder   = 0.1;
     Threshold_DisToSurface   = 2.0;
     Threshold_AngToSurface   = 20.0;
+    Threshold_CylinderWarmStart = 0.05;
 
 #if  _RECON_DATA_
     Threshold_AngToSurface = 30.0;
@@ -216,6 +233,14 @@ void PCFit::initMParams(const char *iniFile)
 	
 		if (keys.contains("Precision_HT"))
 			Precision_HT = conf.value("Precision_HT").toDouble();
+        if (keys.contains("Precision_HTPeaks"))
+            Precision_HTPeaks = conf.value("Precision_HTPeaks").toInt();
+        if (keys.contains("Precision_HTNormAng"))
+            Precision_HTNormAng = conf.value("Precision_HTNormAng").toDouble();
+        if (keys.contains("Precision_HTSpace"))
+            Precision_HTSpace = conf.value("Precision_HTSpace").toInt();
+        if (keys.contains("Precision_HTMaxMB"))
+            Precision_HTMaxMB = conf.value("Precision_HTMaxMB").toInt();
         if (keys.contains("Threshold_MaxModelNumPre"))
             Threshold_MaxModelNumPre = conf.value("Threshold_MaxModelNumPre").toInt();
         if (keys.contains("Threshold_MaxModelNum"))
@@ -230,6 +255,8 @@ void PCFit::initMParams(const char *iniFile)
 			Threshold_DisToSurface = conf.value("Threshold_DisToSurface").toDouble();
 		if (keys.contains("Threshold_AngToSurface"))
 			Threshold_AngToSurface = conf.value("Threshold_AngToSurface").toDouble();
+        if (keys.contains("Threshold_CylinderWarmStart"))
+            Threshold_CylinderWarmStart = conf.value("Threshold_CylinderWarmStart").toDouble();
         
 		if (keys.contains("Threshold_PRAng"))
 			Threshold_PRAng = conf.value("Threshold_PRAng").toDouble();
@@ -255,6 +282,10 @@ bool PCFit::loadPly(const char * plyFilePath)
 			delete m_GEOObjSet;
             m_GEOObjSet = 0;
 		}
+		if (bOpen && m_gcoNeighbors != 0) {
+			delete m_gcoNeighbors;
+			m_gcoNeighbors = 0;
+		}
 	}
 	//----]]
 	if (bOpen)
@@ -516,10 +547,36 @@ bool PCFit::GEOFit(ProType proType, bool keepAttribute)
 		flog("[=RefSize=]: Done in %.4f seconds.\n", time.elapsed() / 1000.0);
 	}
     
-    // [3] Detect Cylinders
+    // [3*] Detect Planes & Cylinders by Efficient RANSAC (Instead of [3] & [4])
     std::vector<ObjCylinder*> objCylinder;
+    std::vector<ObjPatch*> planes;
+    const bool bERansac = (proType & OneStep_DetectPrimitive) != 0;
+    if (bERansac)
+    {
+        flog("\n\n[=PrimitiveFit_ERansac=]: -->> Try to Detect %d Planes & Cylinders by Efficient RANSAC <<--  \n", Threshold_MaxModelNum);
+        time.restart();
+        //-------------------------------
+        DetectPrimitivesERansac(planes, objCylinder, Threshold_MaxModelNum);
+        //-------------------------------
+        flog("[=PrimitiveFit_ERansac=]: Done, %d plane(s) and %d cylinder(s) were detected in %.4f seconds.\n", planes.size(), objCylinder.size(), time.elapsed() / 1000.0);
+    }
+
+    // [3**] Detect Planes & Cylinders as Labels of One MMF-GCO (Instead of [3] & [4])
+    const bool bUnified = !bERansac && (proType & OneStep_DetectUnified) != 0;
+    if (bUnified)
+    {
+        flog("\n\n[=PrimitiveFit_MMFGCO=]: -->> Try to Detect %d Planes & Cylinders by Energy-based Multi-Model Fitting with GCO <<--  \n", Threshold_MaxModelNum);
+        time.restart();
+        //-------------------------------
+        DetectPrimitivesGCO(planes, objCylinder, Threshold_MaxModelNum);
+        //-------------------------------
+        flog("[=PrimitiveFit_MMFGCO=]: Done, %d plane(s) and %d cylinder(s) were detected in %.4f seconds.\n", planes.size(), objCylinder.size(), time.elapsed() / 1000.0);
+    }
+    const bool bOneStep = bERansac || bUnified;
+
+    // [3] Detect Cylinders
     std::vector<ObjPatch*> prePlanes;
-    if ((proType & OneStep_DetectCylinder) != 0) 
+    if (!bOneStep && (proType & OneStep_DetectCylinder) != 0) 
     {
         // -- 3.1 Pre Planes Detect       
         {
@@ -565,14 +622,15 @@ bool PCFit::GEOFit(ProType proType, bool keepAttribute)
     m_GEOObjSet->m_PlaneList.swap(prePlanes); // It May Be Useful
 
 	// [4] Detect All Planes
-    std::vector<ObjPatch*> planes;
-    if ((proType & OneStep_DetectPlane) != 0)
+    if (!bOneStep && (proType & OneStep_DetectPlane) != 0)
 	{
 #if 1 // Detect Planes by Hough Transform
+        // Pre-planes still valid on the points left by the cylinders are kept, the Hough search resumes for the rest
+        const bool bReusePre = (proType & OneStep_ReusePrePlane) != 0 && !m_GEOObjSet->m_PlaneList.empty();
 		flog("\n\n[=PlaneFit_HT=]: -->> Try to Detect %d Planes by Hough Translation <<--  \n", Threshold_MaxModelNum);
 		time.restart();
 		//-------------------------------
-		planes = DetectPlanesHT(Threshold_MaxModelNum);
+		planes = DetectPlanesHT(Threshold_MaxModelNum, bReusePre ? &m_GEOObjSet->m_PlaneList : 0);
 		//-------------------------------
 		flog("[=PlaneFit_HT=]: Done, %d plane(s) were detected in %.4f seconds.\n", planes.size(), time.elapsed() / 1000.0);
 #else // Detect Planes by Multi-Model Fitting with GCO
@@ -602,7 +660,7 @@ bool PCFit::GEOFit(ProType proType, bool keepAttribute)
         m_GEOObjSet->m_SolidList.push_back(cubes.at(i));
     
 	// [6] Set Planes
-    if ((proType & OneStep_DetectPlane) != 0)
+    if (bOneStep || (proType & OneStep_DetectPlane) != 0)
 	{
 		flog("\n\n[=PlanesCheck=]: -->> %d plane(s) are left. << -- \n", planes.size());
         for (int i = 0; i < m_GEOObjSet->m_PlaneList.size(); ++i)
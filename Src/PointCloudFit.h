@@ -32,6 +32,8 @@ enum _PtType {
 int _ResetObjCode(_PtType type);
 int _GetObjCode(_PtType type);
 
+struct MPFGCONeighbors;
+
 class PCFit
 {
 public:
@@ -65,6 +67,9 @@ public:
         OneStep_DetectCylinder   = 0x02,
         OneStep_DetectPlane      = 0x04,
         OneStep_DetectCube       = 0x08,
+        OneStep_DetectPrimitive  = 0x10,  // Planes & Cylinders by Efficient RANSAC, instead of [0x02|0x04]
+        OneStep_DetectUnified    = 0x20,  // Planes & Cylinders as labels of one MMF-GCO, instead of [0x02|0x04]
+        OneStep_ReusePrePlane    = 0x40,  // Pre-planes of [0x02] seed the plane detection of [0x04]
         //---------------------
         SpSteps_OnlyPlane        = 0x04,  // Without Remove Outliers Step
         SpSteps_ToPlane          = 0x06,  // Without Remove Outliers Step
@@ -74,6 +79,14 @@ public:
         Steps_ToPlane            = 0x07,
         Steps_ToCube             = 0x0F,
         Steps_All                = 0x0F,
+        SpSteps_PrimitiveToCube  = 0x18,  // Without Remove Outliers Step
+        Steps_Primitive          = 0x11,
+        Steps_PrimitiveToCube    = 0x19,
+        SpSteps_UnifiedToCube    = 0x28,  // Without Remove Outliers Step
+        Steps_Unified            = 0x21,
+        Steps_UnifiedToCube      = 0x29,
+        SpSteps_ToCubeReusePlane = 0x4E,  // Without Remove Outliers Step
+        Steps_ToCubeReusePlane   = 0x4F,
         //---------------------
         
     };
@@ -93,12 +106,17 @@ public:
 
     // ƽ+Բ
 	double Precision_HT;                     // HTϵ
+    int Precision_HTPeaks;                   // HTŶӵķֵ(Ǽֵ, 1ÿƽһ)
+    double Precision_HTNormAng;              // HTֱͶƱʱķƫ(), 0򰴴ͶƱ
+    int Precision_HTSpace;                   // HTռ: 0-̶, 1-(ۼ)
+    int Precision_HTMaxMB;                   // HTۼڴ(MB), ȴֺ, 0
     int Threshold_MaxModelNumPre;            // ԲǰԤȡƽ
     int Threshold_MaxModelNum;               // ģ͸
 	double Threshold_NPtsPlane;              // ƽֵ
     double Threshold_NPtsCylinder;           // Բֵϵ
 	double Threshold_DisToSurface;           // ƽ+Բֵϵ
 	double Threshold_AngToSurface;           // ƽ+ԲǶֵ
+    double Threshold_CylinderWarmStart;      // Բعʱǩ仯ֵ(С/ֲŻ)
     
     // ƶϲ
 	double Threshold_PRAng;                  // ƽϵǶֵ
@@ -107,6 +125,7 @@ public:
 private:
     MeshDocument m_meshDoc;
     ObjSet *m_GEOObjSet;
+    MPFGCONeighbors *m_gcoNeighbors;         // cached neighbor system of MMF-GCO
     double m_refa;                           // Ȳολ
 private:
 
@@ -115,6 +134,11 @@ private:
         std::vector<vcg::Point3f> &pointList,
         std::vector<vcg::Point3f> &normList,
         const bool moveToCenter = false);
+    // Neighbor system of MMF-GCO, rebuilt only if the point subset OR parameters changed
+    const MPFGCONeighbors &GetGCONeighbors(
+        const std::vector<int> &indexList,
+        const int lambda, const double delta,
+        const int numNeighbors);
 
 	// Preproc
 	int DeNoiseKNN();
@@ -126,7 +150,14 @@ private:
 
     
 	// Detect Plane
-	std::vector<ObjPatch*> DetectPlanesHT(const int expPlaneNum);
+	// [seedPatches] : planes of an earlier pass, kept if still valid before the Hough search
+	std::vector<ObjPatch*> DetectPlanesHT(const int expPlaneNum, const std::vector<ObjPatch*> *seedPatches = 0);
+
+    // Detect Planes & Cylinders By Efficient RANSAC
+    int DetectPrimitivesERansac(
+        std::vector<ObjPatch*> &patches,
+        std::vector<ObjCylinder*> &cylinders,
+        const int expShapeNum);
 	
 	// Detect Cude
     std::vector<ObjCube*> DetectCubeFromPlanes(std::vector<ObjPatch*> &patches);
@@ -138,6 +169,11 @@ private:
     // [ -- !!! IMPLEMENTS ARE TOO SIMILAR !!! -- ]
     std::vector<ObjPatch*> DetectPlanesGCO(const int expPlaneNum, const int iteration = -1);
     std::vector<ObjCylinder*> DetectCylinderGCO(const int expCylinderNum, const int iteration = -1);
+    // Planes (one pass of HT) & cylinders (RANSAC) are the candidate labels of one energy
+    int DetectPrimitivesGCO(
+        std::vector<ObjPatch*> &patches,
+        std::vector<ObjCylinder*> &cylinders,
+        const int expModelNum, const int iteration = -1);
 };
 
 #endif // !_POINT_CLOUD_FIT_H_FILE_
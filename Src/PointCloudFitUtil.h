@@ -3,6 +3,7 @@
 
 #include "PointCloudFit.h"
 #include "utility/flog.h"
+#include "gte/LowLevel/GteMinHeap.h"
 #ifdef _USE_OPENMP_
 #include <omp.h>
 #endif
@@ -87,17 +88,88 @@ enum FixedAxis {
     FixedAxis_Y = 1,
     FixedAxis_Z = 2
 };
+enum HoughSpace {
+    HoughSpace_Axes = 0,    // slopes [a, b] of the three fixed axes, as HoughPlane()
+    HoughSpace_Ball = 1     // orientations on the hemisphere (ball), one accumulator
+};
+// [_normAng] : with normals, <= 0 votes the +-0.3 slope window around each normal,
+//              > 0 votes only the cells of the normal, splatted by a normal deviation
+//              of [_normAng] degrees (near one vote per point). No effect without normals.
 int HoughPlaneOne(
     vcg::Plane3f &Plane,
     const FixedAxis fix,
     const std::vector<vcg::Point3f> &PointList,
     const std::vector<vcg::Point3f> &NormList,
-    const double _intercept, const double _a, const double _s);
+    const double _intercept, const double _a, const double _s,
+    const double _normAng = 0.0);
 int HoughPlane(
     vcg::Plane3f &Plane,
     const std::vector<vcg::Point3f> &PointList,
     const std::vector<vcg::Point3f> &NormList,
-    const double _intercept, const double _a, const double _s);
+    const double _intercept, const double _a, const double _s,
+    const double _normAng = 0.0);
+// Accumulators of HoughPlaneOne() for the three axes, kept over a detection loop.
+// The points are voted once, the votes of the points taken by a plane are subtracted,
+// and peak() gives the same plane & vote as HoughPlane() on the points left.
+// The peak is searched by the maximum of each row of [b], only the rows whose
+// maximum may have moved are scanned again.
+// [HoughSpace_Ball] : ONE accumulator of the orientations evenly on the hemisphere (by [_s]
+//                     in radian) & the offsets [rho] = N*p (by [_a]), a row is a ring of the
+//                     same polar angle. A point votes once per orientation (without normals)
+//                     or the cap around its normal, instead of once per axis.
+// [_maxMB] > 0 : if the accumulators exceed [_maxMB], the points are voted at the coarse
+//                [_s]*ratio & [_a]*ratio, and refine() re-votes the points consistent with
+//                a coarse peak into a small sub-accumulator of [_s] & [_a] around it.
+// [NPeaks] > 1 : one search queues up to [NPeaks] non-maximum suppressed peaks (above
+//                [TVote]) of all axes, peak() pops the strongest one. A queued peak that
+//                lost votes since (to an accepted plane) is re-scored lazily, and a new
+//                search is done only when the queue is empty.
+struct HoughPlaneAccumulator {
+    HoughPlaneAccumulator(const double _intercept, const double _a, const double _s,
+        const double _normAng = 0.0, const HoughSpace _space = HoughSpace_Axes,
+        const double _maxMB = 0.0);
+    ~HoughPlaneAccumulator() { memRelease(); }
+
+    // Vote [Index] of the points (all if 0), [sign] < 0 subtracts the votes cast before
+    void vote(
+        const std::vector<vcg::Point3f> &PointList,
+        const std::vector<vcg::Point3f> &NormList,
+        const std::vector<int> *Index = 0, const int sign = 1);
+    int peak(vcg::Plane3f &Plane, const int NPeaks = 1, const int TVote = 0);
+    // Plane & vote of the coarse peak [Plane] at the fine resolution, on the points left
+    int refine(
+        vcg::Plane3f &Plane,
+        const std::vector<vcg::Point3f> &PointList,
+        const std::vector<vcg::Point3f> &NormList) const;
+    bool isVoted() const { return m_buf[0] != 0; }
+    bool isCoarse() const { return ratio > 1; }
+    void memRelease();
+private:
+    double scale1, scale2;                   // of the voting, [fineScale]*[ratio]
+    double fineScale1, fineScale2;
+    double normAng;
+    HoughSpace space;
+    int ratio;
+    double ballAng;                          // cap voted around a normal on the ball (in radian)
+    int A, B, C;
+    int NAxis;                               // 3 of the axes, or 1 of the ball
+    int NOrient, NRing;                      // orientation cells & rows of an offset [c]
+    int numVoted;
+    std::vector<int> m_ringBeg;              // [NRing+1], first orientation cell of each row
+    std::vector<vcg::Point3f> m_orient;      // [NOrient], normals of the cells of the ball
+    unsigned int *m_buf[3];                  // [C*NOrient] of each axis, as [facPlane] of HoughPlaneOne()
+    std::vector<unsigned int> m_rowMax[3];   // [C*NRing]
+    std::vector<int> m_rowArg[3];            // [C*NRing], first [b] of the maximum
+    std::vector<char> m_rowDirty[3];         // [C*NRing]
+    gte::MinHeap<int, int> m_peakQueue;      // key: axis*NOrient*C + cell, value: -vote
+    void setLayout(const double _intercept, const double _a, const double _s);
+    int rowBeg(const int r) const { return (r / NRing)*NOrient + m_ringBeg[r % NRing]; }
+    int updateRows(const int i);
+    int searchPeaks(const int NPeaks, const int TVote);
+    int peakPlane(vcg::Plane3f &Plane, const int axis, const int cell, const int vote, const double seconds) const;
+    HoughPlaneAccumulator(const HoughPlaneAccumulator &);
+    HoughPlaneAccumulator &operator=(const HoughPlaneAccumulator &);
+};
 
 // [2] Surface Points Verification
 int AttachToPlane(
@@ -108,16 +180,25 @@ int AttachToPlane(
     const double _TDis, const double _TAng);
 
 // [3] Coplanar Separation
+// Regions of [Index] connected by the points closer than [_TDis] (voxel grid & union-find),
+// the largest first and each sorted. Returns the number of the regions.
+int PicRegions(
+    const std::vector<vcg::Point3f> &PointList,
+    const std::vector<int> &Index,
+    const double _TDis,
+    std::vector<std::vector<int>> &Regions);
+// [Index] is replaced by its largest region (see PicRegions())
 void PicMaxRegion(
     const std::vector<vcg::Point3f> &PointList,
     std::vector<int> &Index,
     const double _TDis);
 
-// [4] LS Fit
+// [4] LS Fit, the log is appended to [logBuffer] if given (see flogTo)
 double FinePlane(
     const std::vector<vcg::Point3f> &pointList,
     const std::vector<int> &planeVerList,
-    vcg::Plane3f &plane);
+    vcg::Plane3f &plane,
+    std::string *logBuffer = 0);
 
 // [5] Get Minimum-Bounding-Rectangle
 bool PatchDimensionOne(
@@ -140,6 +221,14 @@ ObjCircle* CircleCheck(
     const std::vector<vcg::Point3f> &PointList,
     const std::vector<int> &PlaneVerList);
 
+// [pSeedPlanes] : planes of an earlier detection, verified (and kept if they still
+//                 pass) in order before the Hough search resumes for the rest.
+// [NPeaksPerPass] : peaks queued by one Hough search, 1 for one search per plane
+//                   (see HoughPlaneAccumulator::peak()).
+// [NormAngHT] : normal deviation (in degree) of the normal-direct voting, 0 for the
+//               window voting (see HoughPlaneOne()).
+// [SpaceHT] : the three axes, or the ball (see HoughPlaneAccumulator).
+// [MaxMBHT] : memory bound of the accumulators (in MB), 0 for no bound.
 int DetectHTPlanes(
     std::vector<vcg::Plane3f> &Planes,
     const std::vector<vcg::Point3f> &pointList,
@@ -150,7 +239,12 @@ int DetectHTPlanes(
     const int ExpPlaneNum = 0,
     std::vector<double> *errors = 0,
     std::vector<ObjPatch*> *pPlanes = 0,
-    CMeshO *pMesh = 0, std::vector<int> *pIndexList = 0);
+    CMeshO *pMesh = 0, std::vector<int> *pIndexList = 0,
+    const std::vector<vcg::Plane3f> *pSeedPlanes = 0,
+    const int NPeaksPerPass = 1,
+    const double NormAngHT = 0.0,
+    const HoughSpace SpaceHT = HoughSpace_Axes,
+    const double MaxMBHT = 0.0);
 
 int ExtractPatches(
     CMeshO &mesh,
@@ -301,18 +395,50 @@ ObjCylinder *EstCylinderTwoPoint(
     const vcg::Point3f p2, const vcg::Point3f n2,
     const double TDisDeviation = (1.0-0.6)/(1.0+0.6),
     const int TAngRequired = 15);
+// CylinderFit_Hemisphere   : exhaustive hemisphere sampling of GTE
+// CylinderFit_CoarseToFine : seeded coarse grid + local refinement + Gauss-Newton
+// CylinderFit_Polish       : local refinement + Gauss-Newton around [initAxis] only
+enum CylinderFitMode {
+    CylinderFit_Hemisphere = 0,
+    CylinderFit_CoarseToFine = 1,
+    CylinderFit_Polish = 2
+};
 ObjCylinder *FineCylinder(
     const std::vector<vcg::Point3f> &pointList,
     const std::vector<int> &cylVerList,
-    double &err);
-
+    double &err,
+    const CylinderFitMode mode = CylinderFit_Hemisphere,
+    const vcg::Point3f *initAxis = 0,
+    const std::vector<vcg::Point3f> *normList = 0);
+// Fit into an existing cylinder (keeps its object code), returns the RMS geometric
+// residual (distance to the axis - radius) in every mode.
+// The log is appended to [logBuffer] if given (see flogTo).
+double FineCylinder(
+    const std::vector<vcg::Point3f> &pointList,
+    const std::vector<int> &cylVerList,
+    ObjCylinder &cyl,
+    const CylinderFitMode mode = CylinderFit_Hemisphere,
+    const vcg::Point3f *initAxis = 0,
+    const std::vector<vcg::Point3f> *normList = 0,
+    std::string *logBuffer = 0);
+
+// RansacScore_Full : count the inliers of each hypothesis over all points
+// RansacScore_SPRT : Wald's SPRT over randomly ordered points, bad hypotheses
+//                    are rejected after a few points, kept ones are exact
+enum RansacScoreMode {
+    RansacScore_Full = 0,
+    RansacScore_SPRT = 1
+};
 double DetectCylinderRansac(
     const std::vector<vcg::Point3f> &pointList, 
     const std::vector<vcg::Point3f> &normList, 
     std::vector<ObjCylinder*> &cylCandidates,
     const double TDis, const double TAng,
     const int maxN = 1, const double inlierRatio = 0.1,
-    const vcg::Box3f *constriantBox = 0);
+    const vcg::Box3f *constriantBox = 0,
+    const RansacScoreMode scoreMode = RansacScore_Full,
+    const bool bParallel = false,
+    const double localRadius = 0.0);
 double FineCylinderLength(
     CMeshO &mesh,
     ObjCylinder &cyl,
@@ -323,6 +449,30 @@ int AttachToCylinder(
 	const double TDis, const double TAng,
 	const double TInlierRatio = 0.0);
 
+/////////////////////////////////
+// ------- Efficient RANSAC -------
+/////////////////////////////////
+// One shape of efficient RANSAC, the connected inliers are refitted by LS.
+struct ERansacShape {
+    _PtType type;               // Pt_OnPlane OR Pt_OnCylinder
+    vcg::Plane3f plane;         // Pt_OnPlane only
+    vcg::Point3f O, N;          // Pt_OnCylinder only, axis
+    double radius;              // Pt_OnCylinder only
+    double err;                 // error of the LS fit
+    std::vector<int> verList;   // inliers, index of [pointList]
+};
+// Planes & cylinders (if normals exist and TNPtsCylinder > 0) compete in one
+// loop, the shapes are returned in the order of extraction.
+int DetectERansacShapes(
+    std::vector<ERansacShape> &shapes,
+    const std::vector<vcg::Point3f> &pointList,
+    const std::vector<vcg::Point3f> &normList,
+    const double TDis, const double TAng,
+    const int TNPtsPlane, const int TNPtsCylinder,
+    const int ExpShapeNum = -1,
+    const vcg::Box3f *constriantBox = 0,
+    const double Probability = 0.99);
+
 ////////////////////////////////////////////////
 // ------- Multi-Model Fitting with GCO -------
 ////////////////////////////////////////////////
@@ -330,57 +480,68 @@ int AttachToCylinder(
 // MCFGCO : Multi-Cylinder Fitting with GCO
 // MMFGCO : Multi-Model Fitting with GCO
 // GCO    : Graph Cut Optimization
+class GCoptimization;
+// Storage of the dense data cost, define _GCO_COST16_ to keep it in 16 bits
+// (half the memory read by each expansion), the costs are saturated at MPFGCODataCostMax.
+#if defined(_GCO_COST16_)
+typedef short MPFGCODataCost;
+static const int MPFGCODataCostMax = 32767;
+#else
+typedef int MPFGCODataCost;
+static const int MPFGCODataCostMax = 10000000; // GCO_MAX_ENERGYTERM
+#endif
+// The smooth cost is always Potts (0 for the same labels, 1 otherwise) times the
+// neighbor weight, GCO sets it up without a table (GCoptimization::setSmoothCostPotts).
 struct MPFGCOCost {
     int numLabel;
     int numSite;
 
-    int *dataCost;
-    int *smoothCost;
+    MPFGCODataCost *dataCost;      // dense  : [numSite*numLabel], 0 if sparse
+    std::vector<int> sparseCost;   // sparse : (site, cost) pairs, label by label
+    std::vector<int> sparseCount;  // sparse : #pairs of each label, empty if dense
     int labelCost;
 
-    MPFGCOCost() : numLabel(0), numSite(0), dataCost(0), smoothCost(0), labelCost(0) {};
+    MPFGCOCost() : numLabel(0), numSite(0), dataCost(0), labelCost(0) {};
     void memRelease() {
         numLabel = 0;
         numSite = 0;
 
-        if (!dataCost)
+        if (dataCost)
             delete[] dataCost;
         dataCost = 0;
-        if (!smoothCost)
-            delete[] smoothCost;
-        smoothCost = 0;
         labelCost = 0;
+        std::vector<int>().swap(sparseCost);
+        std::vector<int>().swap(sparseCount);
     }
 };
+// Neighbor system in CSR, the neighbors of site [i] are [offsets[i], offsets[i+1]) of
+// [indices] & [weights]. Built for a point subset [ptIndex] with the parameters kept below.
 struct MPFGCONeighbors {
     int numNeighbor;
     int numSite;
 
-    int *neighborsCounts;
-    int **neighborsIndexes;
-    int **neighborsWeights;
+    std::vector<int> offsets;      // [numSite+1]
+    std::vector<int> indices;      // [offsets[numSite]]
+    std::vector<int> weights;      // [offsets[numSite]]
+
+    std::vector<int> ptIndex;
+    int lambda;
+    double delta;
+    double unitA;
 
-    MPFGCONeighbors() : numNeighbor(0), numSite(0), neighborsCounts(0), neighborsIndexes(0), neighborsWeights(0) {};
+    MPFGCONeighbors() : numNeighbor(0), numSite(0), lambda(0), delta(0.0), unitA(0.0) {};
+    bool isBuiltFor(const std::vector<int> &_ptIndex, const int _lambda, const double _delta,
+        const int _numNeighbor, const double _unitA) const {
+        return numNeighbor == _numNeighbor && lambda == _lambda && delta == _delta &&
+            unitA == _unitA && ptIndex == _ptIndex;
+    }
     void memRelease() {
         numNeighbor = 0;
         numSite = 0;
-        if (!neighborsCounts)
-            delete[] neighborsCounts;
-        neighborsCounts = 0;
-
-        if (!neighborsIndexes) {
-            if (!neighborsIndexes[0])
-                delete[] neighborsIndexes[0];
-            delete[] neighborsIndexes;
-        }
-        neighborsIndexes = 0;
-
-        if (!neighborsWeights) {
-            if (!neighborsWeights[0])
-                delete[] neighborsWeights[0];
-            delete[] neighborsWeights;
-        }
-        neighborsWeights = 0;;
+        std::vector<int>().swap(offsets);
+        std::vector<int>().swap(indices);
+        std::vector<int>().swap(weights);
+        std::vector<int>().swap(ptIndex);
     }
 };
 
@@ -391,6 +552,8 @@ MPFGCONeighbors MPFGCOParseNeighbors(
     const int numNeighbors = 0,
     const double unit_a = 1.0);
 
+// [band] : distance band in unit a, if > 0 the data cost is sparse and a label is
+//          infeasible for the points out of its band (the noise label is always feasible).
 // [ -- !!! IMPLEMENTS ARE TOO SIMILAR !!! -- ]
 MPFGCOCost MPFGCOGeneratCost(
     const std::vector<ObjCylinder*> &cylinders,
@@ -398,22 +561,103 @@ MPFGCOCost MPFGCOGeneratCost(
     const std::vector<vcg::Point3f> &norms,
     const double unit_a = 1.0,
     const int cost_noise = 0,
-    const int cost_label = 0);
+    const int cost_label = 0,
+    const double band = 0.0);
+MPFGCOCost MPFGCOGeneratCost(
+    const std::vector<vcg::Plane3f> &planes,
+    const std::vector<vcg::Point3f> &points,
+    const std::vector<vcg::Point3f> &norms,
+    const double unit_a = 1.0,
+    const int cost_noise = 0,
+    const int cost_label = 0,
+    const double band = 0.0);
+// Planes & cylinders as the labels of one energy (same costs as above),
+// label [1, NPlane] is a plane and label [NPlane+1, NPlane+NCylinder] a cylinder.
 MPFGCOCost MPFGCOGeneratCost(
     const std::vector<vcg::Plane3f> &planes,
+    const std::vector<ObjCylinder*> &cylinders,
     const std::vector<vcg::Point3f> &points,
     const std::vector<vcg::Point3f> &norms,
     const double unit_a = 1.0,
     const int cost_noise = 0,
-    const int cost_label = 0);
+    const int cost_label = 0,
+    const double band = 0.0);
+// Set the dense OR sparse data cost to [gco]
+void MPFGCOSetDataCost(GCoptimization *gco, const MPFGCOCost &gcoCost);
+
+// GCO session reused by the loops of MMF-GCO.
+// The neighbor system is shared (NOT copied, MUST outlive the session), the labeling of
+// the last loop is kept (and follows the label-set changes) to warm start the next loop.
+// Label 0 is the noise label, label [i+1] is the i-th model.
+class GCoptimizationGeneralGraph;
+struct MMFGCOSession {
+    const MPFGCONeighbors *neighbors;
+    std::vector<int> labels;       // labeling of the last loop, [numSite]
+    bool bWarmStart;               // seed the next loop by [labels]
+    int numTile;                   // > 1 for the partitioned parallel expansion
+    std::vector<int> tiles;        // tile of each site, [numSite]
+
+    MMFGCOSession(const bool _bWarmStart = true)
+        : neighbors(0), bWarmStart(_bWarmStart), numTile(1), m_gco(0), m_numColor(0) {}
+    ~MMFGCOSession() { memRelease(); }
+
+    // Labeling is reset to noise, tiles are cleared
+    void setNeighbors(const MPFGCONeighbors &nei);
+    // Split the sites into spatial tiles of at most [tileSites] sites (median bisection).
+    // Tiles sharing no edge are solved in parallel with the others fixed, then the border
+    // band is solved again. One whole-graph cycle follows only if the band lowered the
+    // energy by more than 1%; the sequential expansion is the fallback if it rises.
+    void setTiles(const std::vector<vcg::Point3f> &points, const int tileSites);
+    // Label-set changes, the sites of a dropped model are set to noise
+    void dropModel(const int i);
+    void mergeModel(const int from, const int to);
+    void swapModels(const int i, const int j);
+    // Alpha-expansion with [gcoCost] (of the current models), result in [labels]
+    void expansion(const MPFGCOCost &gcoCost, const int maxIteration, const bool bRandomOrder = true);
+    void memRelease();
+private:
+    GCoptimizationGeneralGraph *m_gco;
+    std::vector<int> m_counts;     // row views of [neighbors] for GCO
+    std::vector<int*> m_rowIndexes;
+    std::vector<int*> m_rowWeights;
+    std::vector<int> m_edgeOffsets;   // CSR of the edges counted by GCO, both directions
+    std::vector<int> m_edgeSites;
+    std::vector<int> m_edgeWeights;
+    std::vector<int> m_tileColors;    // tiles of a color share no edge
+    int m_numColor;
+    bool partitionedExpansion(const MPFGCOCost &gcoCost, const int maxIteration, long long &tileEnergy);
+    MMFGCOSession(const MMFGCOSession &);
+    MMFGCOSession &operator=(const MMFGCOSession &);
+};
 
 // [ -- !!! IMPLEMENTS ARE TOO SIMILAR !!! -- ]
 std::vector<double> GCOReEstimat(
     std::vector<vcg::Plane3f> &planes,
     const std::vector<vcg::Point3f> &pointList,
     const int *labels, const unsigned int TInlier = 0);
+// Warm-start state of MCF-GCO loops, MUST be kept aligned with the cylinder list.
+// A cylinder is reused   if its label set changed less than [TChange*0.1],
+//                polished if it changed less than [TChange],
+//                refit    otherwise.
+struct MCFGCOWarmStart {
+    std::vector<std::vector<int>> verLists;  // inliers of each cylinder in the last loop
+    std::vector<double> errors;              // fit error of each cylinder in the last loop
+    double TChange;
+    MCFGCOWarmStart(const double _TChange = 0.0) : TChange(_TChange) {}
+    void erase(const int i) {
+        if (i < verLists.size()) verLists.erase(verLists.begin() + i);
+        if (i < errors.size()) errors.erase(errors.begin() + i);
+    }
+    void swap(const int i, const int j) {
+        if (i < verLists.size() && j < verLists.size()) std::swap(verLists.at(i), verLists.at(j));
+        if (i < errors.size() && j < errors.size()) std::swap(errors.at(i), errors.at(j));
+    }
+};
 std::vector<double> GCOReEstimat(
     std::vector<ObjCylinder*> &planes,
     const std::vector<vcg::Point3f> &pointList,
-    const int *labels, const unsigned int TInlier = 0);
+    const int *labels, const unsigned int TInlier = 0,
+    const CylinderFitMode mode = CylinderFit_Hemisphere,
+    const std::vector<vcg::Point3f> *normList = 0,
+    MCFGCOWarmStart *warmStart = 0);
 #endif // !_POINT_CLOUD_FIT_UTIL_H_FILE_
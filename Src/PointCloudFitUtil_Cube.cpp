@@ -952,12 +952,15 @@ bool MergeToCube(
         return true;
     }
     else {// Need Cut
-        while (1) {
+        // Regions Are Picked from the Max (Each Region Is a Split)
+        std::vector<int> allList;
+        for (int i = 0; i < ptsOnPlane.size(); ++i)
+            allList.push_back(i);
+        std::vector<std::vector<int>> regions;
+        PicRegions(ptsOnPlane, allList, TDis, regions);
+        for (int k = 0; k < regions.size(); ++k) {
             // Pick Max
-            std::vector<int> idxList;
-            for (int i = 0; i < ptsOnPlane.size(); ++i)
-                idxList.push_back(i);
-            PicMaxRegion(ptsOnPlane, idxList, TDis);
+            const std::vector<int> &idxList = regions.at(k);
             if (idxList.size() < 300) {
                 for (int i = idxList.size() - 1; i >= 0; --i) {
                     int index = idxList.at(i);
@@ -979,8 +982,6 @@ bool MergeToCube(
                 for (int i = idxList.size() - 1; i >= 0; --i) {
                     int index = idxList.at(i);
                     type_hi[idxOnPlane.at(index)] = newCode;
-                    ptsOnPlane.erase(ptsOnPlane.begin() + index);
-                    idxOnPlane.erase(idxOnPlane.begin() + index);
                 }
             }
             else
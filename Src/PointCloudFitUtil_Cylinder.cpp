@@ -1,5 +1,6 @@
 #include "PointCloudFitUtil.h"
 #include "gte/Mathematics/GteApprCylinder3.h"
+#include "gte/Mathematics/GteLinearSystem.h"
 #include "PCA/PCA.h"
 
 #include <random>
@@ -594,61 +595,517 @@ ObjCylinder *EstCylinderTwoPoint(
 
     return cyl;
 }
+// -- Axis Search Helpers For FineCylinder
+// Error G(W) of the GTE cylinder fitter for a single axis direction W.
+// X MUST be translated by its average, PC is returned in the same frame.
+static double CylinderAxisError(
+    const std::vector<gte::Vector3<double>> &X,
+    const gte::Vector3<double> &W,
+    gte::Vector3<double> &PC, double &rsqr)
+{
+    const int N = X.size();
+    const double invN = 1.0 / N;
+    gte::Matrix3x3<double> P = gte::Matrix3x3<double>::Identity() - gte::OuterProduct(W, W);
+    gte::Matrix3x3<double> S
+    {
+        0.0, -W[2], W[1],
+        W[2], 0.0, -W[0],
+        -W[1], W[0], 0.0
+    };
+
+    gte::Matrix3x3<double> A = gte::Matrix3x3<double>::Zero();
+    gte::Vector3<double> B = gte::Vector3<double>::Zero();
+    double qform = 0.0;
+    for (int i = 0; i < N; ++i) {
+        gte::Vector3<double> Y = P * X[i];
+        double sqrLength = gte::Dot(Y, Y);
+        A += gte::OuterProduct(Y, Y);
+        B += sqrLength * Y;
+        qform += sqrLength;
+    }
+    A *= invN;
+    B *= invN;
+    qform *= invN;
+
+    gte::Matrix3x3<double> Ahat = -S * A * S;
+    PC = (Ahat * B) / gte::Trace<double>(Ahat * A);
+
+    double error = 0.0;
+    rsqr = 0.0;
+    for (int i = 0; i < N; ++i) {
+        gte::Vector3<double> Y = P * X[i];
+        double term = gte::Dot(Y, Y) - gte::Dot(Y, PC) * 2.0 - qform;
+        error += term * term;
+        gte::Vector3<double> diff = PC - Y;
+        rsqr += gte::Dot(diff, diff);
+    }
+    rsqr *= invN;
+    return error * invN;
+}
+// Axis as the direction most perpendicular to all the normals, i.e. the
+// eigenvector of the smallest eigenvalue of Sum{n*n^T}.
+static bool CylinderAxisFromNormals(
+    const std::vector<vcg::Point3f> &normList,
+    const std::vector<int> &cylVerList,
+    gte::Vector3<double> &W)
+{
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    for (int i = 0; i < cylVerList.size(); ++i) {
+        vcg::Point3f n = normList.at(cylVerList.at(i));
+        n.Normalize();
+        a00 += n.X()*n.X(); a01 += n.X()*n.Y(); a02 += n.X()*n.Z();
+        a11 += n.Y()*n.Y(); a12 += n.Y()*n.Z(); a22 += n.Z()*n.Z();
+    }
+    std::array<double, 3> eval;
+    std::array<std::array<double, 3>, 3> evec;
+    gte::SymmetricEigensolver3x3<double>()(a00, a01, a02, a11, a12, a22, false, +1, eval, evec);
+    W = evec[0];
+    return gte::Normalize(W) > 0.0;
+}
+// Moments of a centered point set up to order 4, m[a][b][c] = E[x^a*y^b*z^c].
+// With them G(W) of any direction costs O(1) instead of a pass over points,
+// so any number of candidate directions can be evaluated per point pass.
+struct CylinderMoments {
+    double m[5][5][5];
+    CylinderMoments(const std::vector<gte::Vector3<double>> &X);
+    double Error(const gte::Vector3<double> &W, gte::Vector3<double> &PC, double &rsqr) const;
+};
+CylinderMoments::CylinderMoments(const std::vector<gte::Vector3<double>> &X)
+{
+    memset(m, 0, sizeof(m));
+    const int N = X.size();
+    for (int i = 0; i < N; ++i) {
+        double px[5], py[5], pz[5];
+        px[0] = py[0] = pz[0] = 1.0;
+        for (int k = 1; k < 5; ++k) {
+            px[k] = px[k - 1] * X[i][0];
+            py[k] = py[k - 1] * X[i][1];
+            pz[k] = pz[k - 1] * X[i][2];
+        }
+        for (int a = 0; a < 5; ++a)
+            for (int b = 0; a + b < 5; ++b)
+                for (int c = 0; a + b + c < 5; ++c)
+                    m[a][b][c] += px[a] * py[b] * pz[c];
+    }
+    const double invN = N > 0 ? 1.0 / N : 0.0;
+    for (int a = 0; a < 5; ++a)
+        for (int b = 0; a + b < 5; ++b)
+            for (int c = 0; a + b + c < 5; ++c)
+                m[a][b][c] *= invN;
+}
+// Same value as CylinderAxisError(), expanded with the moments :
+// error = E[(X'PX)^2] - 4E[(X'PX)(X.PC)] + 4PC'M2PC - qform^2, since PC is
+// perpendicular to W and X is centered.
+double CylinderMoments::Error(
+    const gte::Vector3<double> &W, gte::Vector3<double> &PC, double &rsqr) const
+{
+    static const double fact[5] = { 1.0, 1.0, 2.0, 6.0, 24.0 };
+    double pw[3][5];
+    for (int d = 0; d < 3; ++d) {
+        pw[d][0] = 1.0;
+        for (int k = 1; k < 5; ++k)
+            pw[d][k] = pw[d][k - 1] * W[d];
+    }
+
+    // -- E[(W.X)^2 * X_k], E[|X|^2 * X_k] and E[|X|^2 * (W.X)^2]
+    gte::Vector3<double> c = gte::Vector3<double>::Zero();
+    gte::Vector3<double> b0;
+    double xxww = 0.0;
+    for (int a = 0; a < 3; ++a) {
+        for (int b = 0; a + b < 3; ++b) {
+            int _c = 2 - a - b;
+            double coef = fact[2] / (fact[a] * fact[b] * fact[_c]) * pw[0][a] * pw[1][b] * pw[2][_c];
+            c[0] += coef * m[a + 1][b][_c];
+            c[1] += coef * m[a][b + 1][_c];
+            c[2] += coef * m[a][b][_c + 1];
+            xxww += coef * (m[a + 2][b][_c] + m[a][b + 2][_c] + m[a][b][_c + 2]);
+        }
+    }
+    b0[0] = m[3][0][0] + m[1][2][0] + m[1][0][2];
+    b0[1] = m[2][1][0] + m[0][3][0] + m[0][1][2];
+    b0[2] = m[2][0][1] + m[0][2][1] + m[0][0][3];
+
+    // -- E[(W.X)^4] and E[|X|^4]
+    double wwww = 0.0;
+    for (int a = 0; a < 5; ++a) {
+        for (int b = 0; a + b < 5; ++b) {
+            int _c = 4 - a - b;
+            wwww += fact[4] / (fact[a] * fact[b] * fact[_c]) * pw[0][a] * pw[1][b] * pw[2][_c] * m[a][b][_c];
+        }
+    }
+    double xxxx = m[4][0][0] + m[0][4][0] + m[0][0][4] +
+        2.0 * (m[2][2][0] + m[2][0][2] + m[0][2][2]);
+
+    gte::Matrix3x3<double> M2
+    {
+        m[2][0][0], m[1][1][0], m[1][0][1],
+        m[1][1][0], m[0][2][0], m[0][1][1],
+        m[1][0][1], m[0][1][1], m[0][0][2]
+    };
+    gte::Matrix3x3<double> P = gte::Matrix3x3<double>::Identity() - gte::OuterProduct(W, W);
+    gte::Matrix3x3<double> S
+    {
+        0.0, -W[2], W[1],
+        W[2], 0.0, -W[0],
+        -W[1], W[0], 0.0
+    };
+    gte::Matrix3x3<double> A = P * M2 * P;
+    gte::Vector3<double> B = P * (b0 - c);
+    double qform = gte::Trace<double>(A);
+
+    gte::Matrix3x3<double> Ahat = -S * A * S;
+    PC = (Ahat * B) / gte::Trace<double>(Ahat * A);
+    rsqr = gte::Dot(PC, PC) + qform;
+
+    double E1 = xxxx - 2.0 * xxww + wwww;
+    double E2 = gte::Dot(b0 - c, PC);
+    double E3 = gte::Dot(PC, M2 * PC);
+    return E1 - 4.0 * E2 + 4.0 * E3 - qform * qform;
+}
+// Pattern search on the sphere around W, the step (in radian) is halved
+// each time no neighbour improves, until it is smaller than minStep.
+static double RefineCylinderAxis(
+    const CylinderMoments &mom,
+    gte::Vector3<double> &W, double step, const double minStep,
+    int &nEval)
+{
+    gte::Vector3<double> PC;
+    double rsqr;
+    double minError = mom.Error(W, PC, rsqr);
+    nEval++;
+    while (step >= minStep) {
+        gte::Vector3<double> basis[3];
+        basis[0] = W;
+        gte::ComputeOrthogonalComplement(1, basis);
+
+        bool updated = false;
+        gte::Vector3<double> bestW = W;
+        for (int u = -1; u <= 1; ++u) {
+            for (int v = -1; v <= 1; ++v) {
+                if (u == 0 && v == 0)
+                    continue;
+                gte::Vector3<double> _W = W + basis[1] * (u*step) + basis[2] * (v*step);
+                gte::Normalize(_W);
+                double error = mom.Error(_W, PC, rsqr);
+                nEval++;
+                if (error < minError) {
+                    minError = error;
+                    bestW = _W;
+                    updated = true;
+                }
+            }
+        }
+        if (updated)
+            W = bestW;
+        else
+            step *= 0.5;
+    }
+    return minError;
+}
+// Exhaustive search on the hemisphere with the same samples as gte::ApprCylinder3.
+static gte::Vector3<double> HemisphereCylinderAxis(
+    const CylinderMoments &mom,
+    const int numThetaSamples, const int numPhiSamples, int &nEval)
+{
+    const double iMultiplier = GTE_C_TWO_PI / numThetaSamples;
+    const double jMultiplier = GTE_C_HALF_PI / numPhiSamples;
+    gte::Vector3<double> PC, W = { 0.0, 0.0, 1.0 };
+    double rsqr;
+    double minError = mom.Error(W, PC, rsqr);
+
+    // -- Best of each ring, reduced in the serial order so that ties resolve alike
+    std::vector<double> ringError(numPhiSamples, std::numeric_limits<double>::max());
+    std::vector<gte::Vector3<double>> ringW(numPhiSamples);
+#ifdef _USE_OPENMP_
+#pragma omp parallel for
+#endif // !_USE_OPENMP_
+    for (int j = 1; j <= numPhiSamples; ++j) {
+        gte::Vector3<double> _PC;
+        double _rsqr;
+        double phi = jMultiplier * j;
+        double csphi = cos(phi);
+        double snphi = sin(phi);
+        for (int i = 0; i < numThetaSamples; ++i) {
+            double theta = iMultiplier * i;
+            gte::Vector3<double> _W = { cos(theta) * snphi, sin(theta) * snphi, csphi };
+            double error = mom.Error(_W, _PC, _rsqr);
+            if (error < ringError[j - 1]) {
+                ringError[j - 1] = error;
+                ringW[j - 1] = _W;
+            }
+        }
+    }
+    for (int j = 0; j < numPhiSamples; ++j) {
+        if (ringError[j] < minError) {
+            minError = ringError[j];
+            W = ringW[j];
+        }
+    }
+    nEval += numThetaSamples * numPhiSamples + 1;
+    return W;
+}
+// Sum of the squared geometric residuals |(I-WW^T)(X-C)| - r.
+static double CylinderSqrResidual(
+    const std::vector<gte::Vector3<double>> &X,
+    const gte::Vector3<double> &W, const gte::Vector3<double> &C, const double r)
+{
+    double sum = 0.0;
+    for (int i = 0; i < X.size(); ++i) {
+        gte::Vector3<double> P = X[i] - C;
+        gte::Vector3<double> d = P - W * gte::Dot(P, W);
+        double res = gte::Length(d) - r;
+        sum += res*res;
+    }
+    return sum;
+}
+// Gauss-Newton on the geometric residual |(I-WW^T)(X-C)| - r, with the axis
+// rotated and the center moved in the plane perpendicular to W.
+// Return the RMS residual of the polished cylinder.
+static double PolishCylinderGN(
+    const std::vector<gte::Vector3<double>> &X,
+    gte::Vector3<double> &W, gte::Vector3<double> &C, double &r,
+    const int maxIteration = 10)
+{
+    const int N = X.size();
+    double sqrErr = CylinderSqrResidual(X, W, C, r);
+    for (int iter = 0; iter < maxIteration; ++iter) {
+        gte::Vector3<double> basis[3];
+        basis[0] = W;
+        gte::ComputeOrthogonalComplement(1, basis);
+        const gte::Vector3<double> &U = basis[1];
+        const gte::Vector3<double> &V = basis[2];
+
+        // JtJ * delta = -Jt * res, delta := [ axis_u, axis_v, center_u, center_v, radius ]
+        double JtJ[25] = { 0.0 };
+        double Jtr[5] = { 0.0 };
+        for (int i = 0; i < N; ++i) {
+            gte::Vector3<double> P = X[i] - C;
+            double l = gte::Dot(P, W);
+            gte::Vector3<double> d = P - W * l;
+            double rho = gte::Length(d);
+            if (rho <= 0.0)
+                continue;
+            double du = gte::Dot(d, U) / rho;
+            double dv = gte::Dot(d, V) / rho;
+            double J[5] = { -l*du, -l*dv, -du, -dv, -1.0 };
+            double res = rho - r;
+            for (int a = 0; a < 5; ++a) {
+                Jtr[a] -= J[a] * res;
+                for (int b = a; b < 5; ++b)
+                    JtJ[a * 5 + b] += J[a] * J[b];
+            }
+        }
+        for (int a = 0; a < 5; ++a)
+            for (int b = 0; b < a; ++b)
+                JtJ[a * 5 + b] = JtJ[b * 5 + a];
+
+        double delta[5];
+        if (!gte::LinearSystem<double>().Solve(5, JtJ, Jtr, delta))
+            break;
+
+        // Step halving keeps the update descending
+        bool accepted = false;
+        for (double t = 1.0; t > 1.0 / 64; t *= 0.5) {
+            gte::Vector3<double> _W = W + U*(t*delta[0]) + V*(t*delta[1]);
+            gte::Normalize(_W);
+            gte::Vector3<double> _C = C + U*(t*delta[2]) + V*(t*delta[3]);
+            double _r = r + t*delta[4];
+            double _sqrErr = CylinderSqrResidual(X, _W, _C, _r);
+            if (_sqrErr < sqrErr) {
+                accepted = (sqrErr - _sqrErr) > 1e-12 * sqrErr;
+                W = _W; C = _C; r = _r;
+                sqrErr = _sqrErr;
+                break;
+            }
+        }
+        if (!accepted)
+            break;
+    }
+    return sqrt(sqrErr / N);
+}
+
+// Seeded coarse-to-fine search of the axis, the seeds are [initAxis], the
+// normal-derived axis and the best cells of a 15-degree hemisphere grid.
+static gte::Vector3<double> CoarseCylinderAxis(
+    const CylinderMoments &mom,
+    const std::vector<int> &cylVerList,
+    const vcg::Point3f *initAxis,
+    const std::vector<vcg::Point3f> *normList,
+    const double minStep, int &nEval)
+{
+    // -- Seeds: given axis, normal-derived axis and a coarse hemisphere grid
+    std::vector<std::pair<double, gte::Vector3<double>>> cand;
+    gte::Vector3<double> PC, W;
+    double rsqr;
+    if (initAxis != 0) {
+        W = { initAxis->X(), initAxis->Y(), initAxis->Z() };
+        if (gte::Normalize(W) > 0.0) {
+            cand.push_back(std::make_pair(mom.Error(W, PC, rsqr), W));
+            nEval++;
+        }
+    }
+    if (normList != 0 && !normList->empty() &&
+        CylinderAxisFromNormals(*normList, cylVerList, W)) {
+        cand.push_back(std::make_pair(mom.Error(W, PC, rsqr), W));
+        nEval++;
+    }
+    const int NSeed = cand.size();
+    const int numTheta = 24;
+    const int numPhi = 6;
+    const double iMultiplier = GTE_C_TWO_PI / numTheta;
+    const double jMultiplier = GTE_C_HALF_PI / numPhi;
+    W = { 0.0, 0.0, 1.0 };
+    cand.push_back(std::make_pair(mom.Error(W, PC, rsqr), W));
+    nEval++;
+    for (int j = 1; j <= numPhi; ++j) {
+        double phi = jMultiplier * j;
+        for (int i = 0; i < numTheta; ++i) {
+            double theta = iMultiplier * i;
+            W = { cos(theta)*sin(phi), sin(theta)*sin(phi), cos(phi) };
+            cand.push_back(std::make_pair(mom.Error(W, PC, rsqr), W));
+            nEval++;
+        }
+    }
+
+    // -- Refine the seeds and the best coarse cells locally
+    const int NBestCells = 3;
+    std::sort(cand.begin() + NSeed, cand.end(),
+        [](const std::pair<double, gte::Vector3<double>> &a, const std::pair<double, gte::Vector3<double>> &b) {
+        return a.first < b.first; });
+    cand.resize(std::min<int>(cand.size(), NSeed + NBestCells));
+    gte::Vector3<double> bestW = cand[0].second;
+    double minError = std::numeric_limits<double>::max();
+    for (int k = 0; k < cand.size(); ++k) {
+        W = cand[k].second;
+        double error = RefineCylinderAxis(mom, W, jMultiplier * 0.5, minStep, nEval);
+        if (error < minError) {
+            minError = error;
+            bestW = W;
+        }
+    }
+    return bestW;
+}
+
 ObjCylinder *FineCylinder(
     const std::vector<vcg::Point3f> &pointList,
     const std::vector<int> &cylVerList,
-    double &err)
+    double &err,
+    const CylinderFitMode mode,
+    const vcg::Point3f *initAxis,
+    const std::vector<vcg::Point3f> *normList)
+{
+    ObjCylinder *cyl = new ObjCylinder(_GetObjCode(Pt_OnCylinder));
+    err = FineCylinder(pointList, cylVerList, *cyl, mode, initAxis, normList);
+    return cyl;
+}
+double FineCylinder(
+    const std::vector<vcg::Point3f> &pointList,
+    const std::vector<int> &cylVerList,
+    ObjCylinder &cyl,
+    const CylinderFitMode mode,
+    const vcg::Point3f *initAxis,
+    const std::vector<vcg::Point3f> *normList,
+    std::string *logBuffer)
 {
     QTime time;
     time.start();
 
-    std::vector<gte::Vector3<double>> positions;
-    positions.reserve(cylVerList.size());
-    for (unsigned int i = 0; i < cylVerList.size(); ++i)
-    {
-        vcg::Point3f pt = pointList.at(cylVerList.at(i));
-        gte::Vector3<double> data;
-        data[0] = pt.X();
-        data[1] = pt.Y();
-        data[2] = pt.Z();
-        positions.push_back(data);
+    // -- Translate by the average for numerical robustness
+    const int NPts = cylVerList.size();
+    gte::Vector3<double> average = gte::Vector3<double>::Zero();
+    for (int i = 0; i < NPts; ++i) {
+        const vcg::Point3f &pt = pointList.at(cylVerList.at(i));
+        average += gte::Vector3<double>{ pt.X(), pt.Y(), pt.Z() };
+    }
+    average /= (double)std::max(NPts, 1);
+    std::vector<gte::Vector3<double>> X(NPts);
+    for (int i = 0; i < NPts; ++i) {
+        const vcg::Point3f &pt = pointList.at(cylVerList.at(i));
+        X[i] = gte::Vector3<double>{ pt.X(), pt.Y(), pt.Z() } - average;
     }
-    unsigned int numThreads = std::thread::hardware_concurrency();
-    gte::ApprCylinder3<double> fitter(numThreads, 1024, 512);
 
-    unsigned int numVertices = static_cast<unsigned int>(positions.size());
-    gte::Cylinder3<double> cylinder;
-    double minError = fitter(numVertices, positions.data(), cylinder);
+    // -- Axis search, every direction is evaluated with the moments
+    const CylinderMoments mom(X);
+    const double fineStep = D2R(0.01);
+    gte::Vector3<double> PC, W = { 0.0, 0.0, 1.0 };
+    double rsqr;
+    int nEval = 0;
+    const bool localFit = mode != CylinderFit_Hemisphere && NPts >= 6;
+    if (!localFit)
+        W = HemisphereCylinderAxis(mom, 1024, 512, nEval);
+    else if (mode == CylinderFit_Polish && initAxis != 0) {
+        // -- Polish only refines the given axis locally
+        W = { initAxis->X(), initAxis->Y(), initAxis->Z() };
+        if (gte::Normalize(W) <= 0.0)
+            W = { 0.0, 0.0, 1.0 };
+    }
+    else
+        W = CoarseCylinderAxis(mom, cylVerList, initAxis, normList, fineStep * 10, nEval);
 
-    ObjCylinder *cyl = new ObjCylinder(_GetObjCode(Pt_OnCylinder));
-    cyl->m_O.X() = cylinder.axis.origin[0];
-    cyl->m_O.Y() = cylinder.axis.origin[1];
-    cyl->m_O.Z() = cylinder.axis.origin[2];
-    cyl->m_N.X() = cylinder.axis.direction[0];
-    cyl->m_N.Y() = cylinder.axis.direction[1];
-    cyl->m_N.Z() = cylinder.axis.direction[2];
-    cyl->m_radius = cylinder.radius;
-    cyl->m_length = cylinder.height;
-    err = minError;
+    gte::Cylinder3<double> cylinder;
+    double minError;
+    if (localFit) {
+        // -- Final refinement and Gauss-Newton polish over all points,
+        //    the polished center and radius are kept
+        RefineCylinderAxis(mom, W, fineStep * 20, fineStep, nEval);
+        CylinderAxisError(X, W, PC, rsqr);
+        double r = sqrt(rsqr);
+        minError = PolishCylinderGN(X, W, PC, r);
+        cylinder.radius = r;
+        // Keep the axis on the upper hemisphere as the exhaustive search does
+        if (W[2] < 0.0)
+            W = -W;
+    }
+    else {
+        // -- Center is evaluated exactly on the searched axis, the error is
+        //    the RMS residual as in the local fit
+        CylinderAxisError(X, W, PC, rsqr);
+        cylinder.radius = sqrt(rsqr);
+        minError = sqrt(CylinderSqrResidual(X, W, PC, cylinder.radius) / std::max(NPts, 1));
+    }
+    cylinder.axis.origin = PC;
+    cylinder.axis.direction = W;
+
+    double tmin = 0.0, tmax = 0.0;
+    for (int i = 0; i < NPts; ++i) {
+        double t = gte::Dot(cylinder.axis.direction, X[i] - cylinder.axis.origin);
+        tmin = std::min(t, tmin);
+        tmax = std::max(t, tmax);
+    }
+    cylinder.axis.origin += ((tmin + tmax) * 0.5) * cylinder.axis.direction + average;
+    cylinder.height = tmax - tmin;
+
+    cyl.m_O.X() = cylinder.axis.origin[0];
+    cyl.m_O.Y() = cylinder.axis.origin[1];
+    cyl.m_O.Z() = cylinder.axis.origin[2];
+    cyl.m_N.X() = cylinder.axis.direction[0];
+    cyl.m_N.Y() = cylinder.axis.direction[1];
+    cyl.m_N.Z() = cylinder.axis.direction[2];
+    cyl.m_radius = cylinder.radius;
+    cyl.m_length = cylinder.height;
     
     
 
-    flog(
+    flogTo(logBuffer,
         "      [--Fit_Cylinder--]: #Pts-%d\n"
         "        | #ID        : %d\n"
-        "        | #min error : %7.4f\n"
+        "        | #Mode      : %s [ %d axis evaluated ]\n"
+        "        | #RMS error : %7.4f\n"
         "        | #Center    : < %7.4f, %7.4f, %7.4f > \n"
         "        | #direction : < %7.4f, %7.4f, %7.4f > \n"
         "        | #radius    : %7.4f\n"
         "        | #height    : %7.4f\n"
         "      [--Fit_Cylinder--]: Done in %.4f seconds. \n",
-        cylVerList.size(), cyl->m_index, err,
-        cyl->m_O.X(), cyl->m_O.Y(), cyl->m_O.Z(),
-        cyl->m_N.X(), cyl->m_N.Y(), cyl->m_N.Z(),
-        cyl->m_radius, cyl->m_length,
+        cylVerList.size(), cyl.m_index,
+        mode == CylinderFit_Hemisphere ? "Hemisphere" :
+        mode == CylinderFit_Polish ? "Polish" : "CoarseToFine", nEval,
+        minError,
+        cyl.m_O.X(), cyl.m_O.Y(), cyl.m_O.Z(),
+        cyl.m_N.X(), cyl.m_N.Y(), cyl.m_N.Z(),
+        cyl.m_radius, cyl.m_length,
         time.elapsed() / 1000.0);
 
-    return cyl;
+    return minError;
 }
 
 
@@ -661,6 +1118,76 @@ int RansacTimes(const double Percentage, const double InlierRatio, const int Min
     // >> T = log(1-P)/log(1-I^N)
     return log(1 - Percentage) / log(1 - pow(InlierRatio, MiniSupportNum)) + 0.5;
 }
+int RansacTimesLocal(const double Percentage, const double InlierRatio, const double LocalInlierRatio) {
+    // Same as RansacTimes() with 2 samples, the 2nd one is drawn around the 1st
+    // and lies on the same model with probability L := LocalInlierRatio.
+    // >> T = log(1-P)/log(1-I*L)
+    return log(1 - Percentage) / log(1 - InlierRatio*LocalInlierRatio) + 0.5;
+}
+// Sparse uniform grid for localized (NAPSAC-like) sampling, the points are
+// stored cell by cell and the non-empty cells are sorted by their keys.
+struct RansacLocalGrid {
+    vcg::Point3f lo;
+    double cell;
+    long long NX, NY, NZ;
+    std::vector<long long> keys;
+    std::vector<int> start;
+    std::vector<int> index;
+    RansacLocalGrid(const std::vector<vcg::Point3f> &pointList, const double _cell);
+    long long Key(const vcg::Point3f &p, long long &x, long long &y, long long &z) const;
+    int Sample(const vcg::Point3f &p, const int i0, const unsigned long long r) const;
+};
+RansacLocalGrid::RansacLocalGrid(const std::vector<vcg::Point3f> &pointList, const double _cell)
+    : cell(_cell)
+{
+    vcg::Box3f box;
+    for (int i = 0; i < pointList.size(); ++i)
+        box.Add(pointList[i]);
+    lo = box.min;
+    NX = box.DimX() / cell + 1;
+    NY = box.DimY() / cell + 1;
+    NZ = box.DimZ() / cell + 1;
+
+    long long x, y, z;
+    std::vector<std::pair<long long, int>> cellPts(pointList.size());
+    for (int i = 0; i < pointList.size(); ++i)
+        cellPts[i] = std::make_pair(Key(pointList[i], x, y, z), i);
+    std::sort(cellPts.begin(), cellPts.end());
+    index.resize(cellPts.size());
+    for (int i = 0; i < cellPts.size(); ++i) {
+        index[i] = cellPts[i].second;
+        if (i == 0 || cellPts[i].first != cellPts[i - 1].first) {
+            keys.push_back(cellPts[i].first);
+            start.push_back(i);
+        }
+    }
+    start.push_back(cellPts.size());
+}
+long long RansacLocalGrid::Key(const vcg::Point3f &p, long long &x, long long &y, long long &z) const
+{
+    x = std::min<long long>(std::max<long long>((p.X() - lo.X()) / cell, 0), NX - 1);
+    y = std::min<long long>(std::max<long long>((p.Y() - lo.Y()) / cell, 0), NY - 1);
+    z = std::min<long long>(std::max<long long>((p.Z() - lo.Z()) / cell, 0), NZ - 1);
+    return (x * NY + y) * NZ + z;
+}
+// A point from one of the 27 cells around [p] picked by the random number [r],
+// returns -1 if the cell is empty or the point is [i0] itself.
+int RansacLocalGrid::Sample(const vcg::Point3f &p, const int i0, const unsigned long long r) const
+{
+    long long x, y, z;
+    Key(p, x, y, z);
+    x += int(r % 3) - 1;
+    y += int(r / 3 % 3) - 1;
+    z += int(r / 9 % 3) - 1;
+    if (x < 0 || y < 0 || z < 0 || x >= NX || y >= NY || z >= NZ)
+        return -1;
+    auto iter = std::lower_bound(keys.begin(), keys.end(), (x * NY + y) * NZ + z);
+    if (iter == keys.end() || *iter != (x * NY + y) * NZ + z)
+        return -1;
+    int c = iter - keys.begin();
+    int i1 = index[start[c] + (r / 27) % (start[c + 1] - start[c])];
+    return i1 == i0 ? -1 : i1;
+}
 void AddLimitList(
     std::list<WCylinder> &cyls, const WCylinder &cyl, const int maxN)
 {
@@ -681,20 +1208,77 @@ void AddLimitList(
         }
     }
 }
+// Decision threshold A of the SPRT [Matas & Chum, 2008], solved from
+// A = tM*C + 1 + log(A), where tM is the cost of a hypothesis in units of
+// one point verification and C the expected per-point information.
+double SPRTThreshold(const double epsilon, const double delta, const double tM = 200.0)
+{
+    double C = (1 - delta)*log((1 - delta) / (1 - epsilon)) + delta*log(delta / epsilon);
+    double A = tM*C + 1;
+    for (int i = 0; i < 10; ++i) {
+        double _A = tM*C + 1 + log(A);
+        if (abs(_A - A) < 1e-6)
+            break;
+        A = _A;
+    }
+    return A;
+}
+// Count inliers along [order] with Wald's SPRT, returns -1 if the hypothesis
+// is rejected. nEval and nEvalInlier are the points checked and found inlier.
+int CylinderInliersSPRT(
+    const ObjCylinder &cyl,
+    const std::vector<vcg::Point3f> &pointList,
+    const std::vector<vcg::Point3f> &normList,
+    const std::vector<int> &order,
+    const double TDis, const double TAng,
+    const double logA, const double logInlier, const double logOutlier,
+    int &nEval, int &nEvalInlier)
+{
+    int inliers = 0;
+    double logLambda = 0.0;
+    for (int i = 0; i < order.size(); ++i) {
+        int k = order[i];
+        if (CylinderInlier(cyl, pointList[k], TDis, normList[k], TAng)) {
+            inliers++;
+            logLambda += logInlier;
+        }
+        else
+            logLambda += logOutlier;
+        if (logLambda > logA) {
+            nEval = i + 1;
+            nEvalInlier = inliers;
+            return -1;
+        }
+    }
+    nEval = order.size();
+    nEvalInlier = inliers;
+    return inliers;
+}
+// Counter-based random stream, the [i]-th number only depends on [seed] and [i].
+inline unsigned long long SplitMix64(unsigned long long x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
 double DetectCylinderRansac(
     const std::vector<vcg::Point3f> &pointList,
     const std::vector<vcg::Point3f> &normList,
     std::vector<ObjCylinder*> &cylCandidates,
     const double TDis, const double TAng,
     const int maxN, const double inlierRatio,
-    const vcg::Box3f *constriantBox)
+    const vcg::Box3f *constriantBox,
+    const RansacScoreMode scoreMode,
+    const bool bParallel,
+    const double localRadius)
 {
     assert(pointList.size() == normList.size());
     assert(inlierRatio > 0.0 && inlierRatio < 1.0);
     QTime time;
     time.start();
 
-    if (pointList.size() == 0)
+    if (pointList.size() < 2) // Two samples per hypothesis
         return -1.0;
 
     const int NPts = pointList.size();
@@ -703,7 +1287,13 @@ double DetectCylinderRansac(
     const double TDisDeviation = (1-0.6) / (1+0.6);
     const int TAngRequired = 15;
     const int SupportN = 2;
-    const int TheoryIteration = RansacTimes(Percentage, inlierRatio*0.1, SupportN);
+    // -- Localized sampling : the 2nd sample is on the same model as the 1st
+    //    with a much higher probability than the global inlier ratio.
+    const bool bLocal = localRadius > 0.0;
+    const double LocalInlierRatio = 0.5;
+    const int TheoryIteration = bLocal ?
+        RansacTimesLocal(Percentage, inlierRatio*0.1, LocalInlierRatio) :
+        RansacTimes(Percentage, inlierRatio*0.1, SupportN);
     const int MaxIteration = TheoryIteration < 10 ? 10 : (TheoryIteration > 1e4 ? 1e4 : TheoryIteration);
     const double MaxR = (constriantBox == 0) ? 0.0 : constriantBox->Dim().V(constriantBox->MinDim());
 
@@ -715,44 +1305,153 @@ double DetectCylinderRansac(
     idx.reserve(NPts);
     for (int i = 0; i < NPts; ++i)
         idx.push_back(i);
-    while (iter < MaxIteration) {
-        iter++;       
-        vcg::Point3f p[2], n[2];
-        // Random Pick
-        for (int i = 0; i < 2; ++i) {
-            // Random distribution
-            std::uniform_int_distribution<int> distribution(i, NPts - 1);
-            int k = distribution(randomEngine);
-            std::swap(idx[i], idx[k]);
-            p[i] = pointList.at(idx[i]);
-            n[i] = normList.at(idx[i]);
-        }     
+
+    // -- SPRT : epsilon is the required inlier ratio, delta the inlier ratio
+    //    of bad hypotheses, re-estimated from the rejected ones.
+    //    Points are checked in a random order of their own engine, so that
+    //    the sampling sequence is the same as in the full scoring mode.
+    const bool bSPRT = scoreMode == RansacScore_SPRT;
+    const double epsilon = inlierRatio;
+    double delta = std::min(0.01, epsilon * 0.5);
+    double logA = log(SPRTThreshold(epsilon, delta));
+    std::vector<int> order;
+    if (bSPRT) {
+        order = idx;
+        std::shuffle(order.begin(), order.end(), std::default_random_engine(1));
+    }
+    long long nEvalAll = 0, nEvalRejected = 0, nInlierRejected = 0;
+    int nScored = 0, nRejected = 0;
+    RansacLocalGrid *grid = bLocal ? new RansacLocalGrid(pointList, localRadius) : 0;
+
+    // -- One hypothesis from two samples, only reads shared data.
+    //    [cyl] is kept only if it is a good model, otherwise it is deleted.
+    struct Hypothesis {
+        ObjCylinder *cyl;
+        double ratio;
+        int nEval, nEvalInlier;
+        bool rejected;   // Rejected early by SPRT
+    };
+    auto Score = [&](const int i0, const int i1,
+        const double _logA, const double _delta) -> Hypothesis {
+        Hypothesis h = { 0, 0.0, 0, 0, false };
+        if (i1 < 0) // Fail to Pick Around i0
+            return h;
         // Estimate
-        ObjCylinder *cyl = EstCylinderTwoPoint(p[0], n[0], p[1], n[1], TDisDeviation, TAngRequired);
+        ObjCylinder *cyl = EstCylinderTwoPoint(
+            pointList.at(i0), normList.at(i0),
+            pointList.at(i1), normList.at(i1), TDisDeviation, TAngRequired);
         if (cyl == 0) // Fail to Est by Two Points
-            continue;
+            return h;
 
         // Good Model Check
         if (constriantBox != 0 && (
             !constriantBox->IsIn(cyl->m_O) ||
             cyl->m_radius > MaxR / 2.0)) { // Not A Good Model For Loc & Size
             delete cyl;
-            continue;
+            return h;
+        }
+        int inliers = 0;
+        if (bSPRT) {
+            inliers = CylinderInliersSPRT(*cyl, pointList, normList, order, TDis, TAng,
+                _logA, log(_delta / epsilon), log((1 - _delta) / (1 - epsilon)), h.nEval, h.nEvalInlier);
+            h.rejected = inliers < 0;
+        }
+        else {
+            inliers = CylinderInliers(*cyl, pointList, normList, TDis, TAng);
+            h.nEval = NPts;
         }
-        double inlierRatio_this = CylinderInliers(*cyl, pointList, normList, TDis, TAng) * 1.0 / NPts;
-        if (inlierRatio_this < inlierRatio) { // Not A Good Model For Inlier Ratio
+        h.ratio = inliers * 1.0 / NPts;
+        if (h.rejected || h.ratio < inlierRatio) { // Not A Good Model For Inlier Ratio
             delete cyl;
-            continue;
+            return h;
         }
+        h.cyl = cyl;
+        return h;
+    };
+    // -- Book-keeping of one hypothesis, MUST run in iteration order
+    auto Accept = [&](const Hypothesis &h) {
+        if (h.nEval == 0)
+            return;
+        nScored++;
+        nEvalAll += h.nEval;
+        if (h.rejected) {
+            nRejected++;
+            nEvalRejected += h.nEval;
+            nInlierRejected += h.nEvalInlier;
+        }
+        if (h.cyl == 0)
+            return;
 
         // A Good Model
-        AddLimitList(cyls, WCylinder(cyl, inlierRatio_this), maxN);
+        AddLimitList(cyls, WCylinder(h.cyl, h.ratio), maxN);
 
         // Update Param
-        if (inlierRatio_this > maxInlierRatio) {
-            maxInlierRatio = inlierRatio_this;
+        if (h.ratio > maxInlierRatio) {
+            maxInlierRatio = h.ratio;
+        }
+    };
+    // -- Update delta & A if the estimation moves by more than 5%
+    auto UpdateSPRT = [&]() {
+        if (!bSPRT || nEvalRejected == 0)
+            return;
+        double _delta = std::max(1e-4, std::min(nInlierRejected * 1.0 / nEvalRejected, epsilon * 0.9));
+        if (abs(_delta - delta) > delta * 0.05) {
+            delta = _delta;
+            logA = log(SPRTThreshold(epsilon, delta));
+        }
+    };
+
+    if (!bParallel) {
+        while (iter < MaxIteration) {
+            iter++;
+            // Random Pick
+            for (int i = 0; i < (bLocal ? 1 : 2); ++i) {
+                // Random distribution
+                std::uniform_int_distribution<int> distribution(i, NPts - 1);
+                int k = distribution(randomEngine);
+                std::swap(idx[i], idx[k]);
+            }
+            // Local partner is not written into [idx], it is not a permutation slot
+            const int i1 = bLocal ? grid->Sample(pointList[idx[0]], idx[0], randomEngine()) : idx[1];
+            Accept(Score(idx[0], i1, logA, delta));
+            UpdateSPRT();
         }
     }
+    else {
+        // -- Iterations are drawn from a counter-based stream and scored in
+        //    batches, results are merged in iteration order and SPRT is only
+        //    updated between batches: the result does not depend on the
+        //    number of threads.
+        const unsigned long long seed = 0;
+        const int NBatch = 256;
+        std::vector<Hypothesis> batch(NBatch);
+        for (int b0 = 0; b0 < MaxIteration; b0 += NBatch) {
+            const int b1 = std::min(b0 + NBatch, MaxIteration);
+            const double _logA = logA;
+            const double _delta = delta;
+#ifdef _USE_OPENMP_
+#pragma omp parallel for schedule(dynamic, 8)
+#endif // !_USE_OPENMP_
+            for (int it = b0; it < b1; ++it) {
+                // Two distinct samples
+                unsigned long long r0 = SplitMix64(seed + 2 * (unsigned long long)it);
+                unsigned long long r1 = SplitMix64(seed + 2 * (unsigned long long)it + 1);
+                int i0 = r0 % NPts;
+                int i1 = r1 % (NPts - 1);
+                if (i1 >= i0)
+                    i1++;
+                if (bLocal)
+                    i1 = grid->Sample(pointList[i0], i0, r1);
+                batch[it - b0] = Score(i0, i1, _logA, _delta);
+            }
+            for (int it = b0; it < b1; ++it)
+                Accept(batch[it - b0]);
+            UpdateSPRT();
+            iter = b1;
+        }
+    }
+
+    delete grid;
 
     std::vector<ObjCylinder*> _cylCandidates;
     _cylCandidates.reserve(cyls.size());
@@ -765,11 +1464,18 @@ double DetectCylinderRansac(
         "        | #ExpInlier  : %7.4f \n"
         "        | #CanNum     : %d \n"
         "        | #MaxInlier  : %7.4f \n"
-        "        | #Iteration  : %d - [ %d | %d ] \n"
+        "        | #Iteration  : %d - [ %d | %d ] %s\n"
+        "        | #Sampling   : %s [ radius = %.4f ] \n"
+        "        | #Scoring    : %s - [ %d scored | %d rejected early ] \n"
+        "        | #EvalPts    : %.1f per hypothesis [ %.1f per rejected | delta = %.4f ] \n"
         "      [--DetectCylinderRansac--]: Done in %.4f seconds. \n",
         NPts, maxN, inlierRatio,
         cyls.size(), maxInlierRatio,
-        iter, MaxIteration, TheoryIteration,
+        iter, MaxIteration, TheoryIteration, bParallel ? "Parallel" : "",
+        bLocal ? "Local" : "Uniform", localRadius,
+        bSPRT ? "SPRT" : "Full", nScored, nRejected,
+        nScored > 0 ? nEvalAll * 1.0 / nScored : 0.0,
+        nRejected > 0 ? nEvalRejected * 1.0 / nRejected : 0.0, delta,
         time.elapsed() / 1000.0);    
 
     return maxInlierRatio;
@@ -0,0 +1,448 @@
+#include "PointCloudFitUtil.h"
+
+#include <random>
+#include <algorithm>
+
+// Efficient RANSAC (R. Schnabel, R. Wahl, R. Klein, Efficient RANSAC for
+// Point-Cloud Shape Detection, 2007).
+// -- Minimal sets are drawn inside the octree cell of a random first point,
+//    the level of the cell is chosen by the levels that gave good candidates.
+// -- Candidates are scored lazily on growing prefixes of a random order of the
+//    remaining points, only the ones whose confidence interval overlaps the
+//    best one are scored further.
+// -- The best candidate is extracted once the probability of having missed a
+//    larger one is low enough, planes and cylinders compete in the same pool.
+
+// -- Octree Over Morton Codes
+// The remaining points sorted by their Morton codes, a cell of level [l] is
+// the range of points sharing the first 3*l bits of the code.
+static const int ERansacMaxLevel = 10;
+struct ERansacOctree {
+    vcg::Point3f lo;
+    double scale;
+    std::vector<unsigned int> codes;
+    std::vector<int> pts;
+
+    static unsigned int Spread(unsigned int v) {
+        v = (v | (v << 16)) & 0x030000FF;
+        v = (v | (v << 8)) & 0x0300F00F;
+        v = (v | (v << 4)) & 0x030C30C3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+    void Build(const std::vector<vcg::Point3f> &pointList) {
+        const int NPts = pointList.size();
+        vcg::Box3f box;
+        for (int i = 0; i < NPts; ++i)
+            box.Add(pointList.at(i));
+        const double dim = std::max(box.Dim().V(box.MaxDim()), 1e-6f);
+        const int NCell = 1 << ERansacMaxLevel;
+        lo = box.min;
+        scale = (NCell - 1) / dim;
+
+        std::vector<std::pair<unsigned int, int>> list(NPts);
+        for (int i = 0; i < NPts; ++i) {
+            vcg::Point3f q = (pointList.at(i) - lo) * scale;
+            list[i].first =
+                Spread(std::min(int(q.X()), NCell - 1)) |
+                (Spread(std::min(int(q.Y()), NCell - 1)) << 1) |
+                (Spread(std::min(int(q.Z()), NCell - 1)) << 2);
+            list[i].second = i;
+        }
+        std::sort(list.begin(), list.end());
+        codes.resize(NPts);
+        pts.resize(NPts);
+        for (int i = 0; i < NPts; ++i) {
+            codes[i] = list[i].first;
+            pts[i] = list[i].second;
+        }
+    }
+    void Remove(const std::vector<char> &removed) {
+        int n = 0;
+        for (int i = 0; i < pts.size(); ++i) {
+            if (removed[pts[i]])
+                continue;
+            codes[n] = codes[i];
+            pts[n] = pts[i];
+            n++;
+        }
+        codes.resize(n);
+        pts.resize(n);
+    }
+    // Range [b, e) of the cell of [level] containing the i-th point
+    void Cell(const int i, const int level, int &b, int &e) const {
+        const int shift = 3 * (ERansacMaxLevel - level);
+        const unsigned int key = codes[i] >> shift;
+        b = std::lower_bound(codes.begin(), codes.end(), key << shift) - codes.begin();
+        e = std::lower_bound(codes.begin(), codes.end(), (key + 1) << shift) - codes.begin();
+    }
+};
+
+// -- Shape Candidate
+// Scored on the first [nEval] points of the random order, [score] of them are inliers.
+struct ERansacCandidate {
+    _PtType type;
+    vcg::Plane3f plane;
+    vcg::Point3f O, N;
+    double radius;
+    int level;
+    int nEval;
+    int score;
+
+    double Expected(const int NPts) const {
+        return nEval > 0 ? double(score) * NPts / nEval : 0.0;
+    }
+    // ~95% interval of the score over all [NPts] points, normal approximation
+    // of the hypergeometric distribution of the inliers in the prefix.
+    void Bounds(const int NPts, double &lo, double &hi) const {
+        const double E = Expected(NPts);
+        const double p = (score + 1.0) / (nEval + 2.0);
+        const double fpc = NPts > 1 ? double(NPts - nEval) / (NPts - 1) : 0.0;
+        const double sd = nEval > 0 ? NPts * sqrt(p*(1.0 - p) / nEval * fpc) : NPts;
+        lo = E - 2.0*sd;
+        hi = E + 2.0*sd;
+    }
+};
+static bool ERansacInlier(
+    const ERansacCandidate &c,
+    const vcg::Point3f &p, const vcg::Point3f *n,
+    const double TDis, const double cosTAng)
+{
+    if (c.type == Pt_OnPlane) {
+        const vcg::Point3f &N = c.plane.Direction();
+        if (abs(N*p - c.plane.Offset()) >= TDis)
+            return false;
+        return n == 0 || abs(N*(*n)) > cosTAng*n->Norm();
+    }
+    else {
+        vcg::Point3f op = p - c.O;
+        vcg::Point3f np = op - c.N*(op*c.N);
+        const double r = np.Norm();
+        if (abs(r - c.radius) >= TDis)
+            return false;
+        return n == 0 || abs(np*(*n)) > cosTAng*r*n->Norm();
+    }
+}
+// Extend the scored prefix of [c] to [to] points of [order]
+static long long ERansacScore(
+    ERansacCandidate &c, const int to,
+    const std::vector<int> &order,
+    const std::vector<vcg::Point3f> &pointList,
+    const std::vector<vcg::Point3f> &normList,
+    const double TDis, const double cosTAng)
+{
+    const bool bHasNorm = !normList.empty();
+    const int from = c.nEval;
+    for (int i = from; i < to; ++i) {
+        const int idx = order[i];
+        if (ERansacInlier(c, pointList[idx], bHasNorm ? &normList[idx] : 0, TDis, cosTAng))
+            c.score++;
+    }
+    c.nEval = std::max(from, to);
+    return std::max(0, to - from);
+}
+// Connected inliers of [c] among [order], refitted by LS
+static double ERansacExtract(
+    ERansacCandidate &c, std::vector<int> &verList,
+    const std::vector<int> &order,
+    const std::vector<vcg::Point3f> &pointList,
+    const std::vector<vcg::Point3f> &normList,
+    const double TDis, const double cosTAng)
+{
+    const bool bHasNorm = !normList.empty();
+    double err = 0.0;
+    for (int pass = 0; pass < 2; ++pass) {
+        verList.clear();
+        for (int i = 0; i < order.size(); ++i) {
+            const int idx = order[i];
+            if (ERansacInlier(c, pointList[idx], bHasNorm ? &normList[idx] : 0, TDis, cosTAng))
+                verList.push_back(idx);
+        }
+        PicMaxRegion(pointList, verList, TDis);
+        if (verList.size() < 6 || pass == 1)
+            break;
+
+        // Least Squre Fit, the inliers are collected AGAIN with the fitted shape
+        if (c.type == Pt_OnPlane) {
+            err = FinePlane(pointList, verList, c.plane);
+        }
+        else {
+            ObjCylinder cyl(0);
+            cyl.m_O = c.O;
+            cyl.m_N = c.N;
+            cyl.m_radius = c.radius;
+            cyl.m_length = 1.0;
+            err = FineCylinder(pointList, verList, cyl, CylinderFit_Polish, &c.N, &normList);
+            c.O = cyl.m_O;
+            c.N = cyl.m_N;
+            c.N.Normalize();
+            c.radius = cyl.m_radius;
+        }
+    }
+    return err;
+}
+
+int DetectERansacShapes(
+    std::vector<ERansacShape> &shapes,
+    const std::vector<vcg::Point3f> &pointList,
+    const std::vector<vcg::Point3f> &normList,
+    const double TDis, const double TAng,
+    const int TNPtsPlane, const int TNPtsCylinder,
+    const int ExpShapeNum,
+    const vcg::Box3f *constriantBox,
+    const double Probability)
+{
+    QTime time;
+    time.start();
+    shapes.clear();
+
+    const int NPts = pointList.size();
+    const bool bHasNorm = !normList.empty();
+    const bool bCylinder = bHasNorm && TNPtsCylinder > 0;
+    if (bHasNorm)
+        assert(normList.size() == NPts);
+    const double cosTAng = cos(D2R(TAng));
+    const int TMinSupport = bCylinder ? std::min(TNPtsPlane, TNPtsCylinder) : TNPtsPlane;
+    const double MaxR = (constriantBox == 0) ? 0.0 : constriantBox->Dim().V(constriantBox->MinDim());
+
+    const int NLevel = ERansacMaxLevel + 1;
+    const int NSample = 3;                 // plane by 3 points, cylinder by the first 2 with normals
+    const int BatchSize = 32;              // minimal sets drawn before each selection
+    const int MaxCandidates = 512;         // pool size, the lowest upper bounds are dropped
+    const int MaxDraw = 1e5;
+    const int MaxFailure = 20;             // extracted shapes shrunk below the minimum by connectivity
+
+    // -- Remaining Points
+    std::vector<char> removed(NPts, 0);
+    std::vector<int> order(NPts);
+    for (int i = 0; i < NPts; ++i)
+        order[i] = i;
+    std::default_random_engine randomEngine; // Keep the result same
+    std::shuffle(order.begin(), order.end(), randomEngine);
+    ERansacOctree octree;
+    octree.Build(pointList);
+
+    // -- Level Statistics, a level is drawn by the mean score of its candidates
+    std::vector<double> levelScore(NLevel, 1.0);
+    std::vector<double> levelDraws(NLevel, 1.0);
+
+    std::vector<ERansacCandidate> pool;
+    int nDraw = 0, nFailure = 0, nPlane = 0, nCylinder = 0;
+    long long nEvalPts = 0;
+    auto MinSupport = [&](const ERansacCandidate &c) {
+        return c.type == Pt_OnPlane ? TNPtsPlane : TNPtsCylinder;
+    };
+    // Probability to draw a minimal set on a shape of [n] points in one draw
+    auto DrawProbability = [&](const double n) {
+        return std::min(1.0, n / (double(order.size()) * NLevel * (1 << (NSample - 1))));
+    };
+    auto FirstSubset = [&]() {
+        return std::min(int(order.size()), std::max(256, int(order.size() / 64)));
+    };
+
+    while (!order.empty() && order.size() >= TMinSupport && nDraw < MaxDraw)
+    {
+        if (ExpShapeNum >= 0 && shapes.size() >= ExpShapeNum)
+            break;
+        const int NRemain = order.size();
+
+        // -- Draw New Candidates
+        for (int b = 0; b < BatchSize; ++b, ++nDraw) {
+            const int i0 = std::uniform_int_distribution<int>(0, NRemain - 1)(randomEngine);
+            double sum = 0.0;
+            for (int l = 0; l < NLevel; ++l)
+                sum += levelScore[l] / levelDraws[l];
+            double r = std::uniform_real_distribution<double>(0.0, 1.0)(randomEngine);
+            int level = 0;
+            for (; level < NLevel - 1; ++level) {
+                r -= 0.9 * levelScore[level] / levelDraws[level] / sum + 0.1 / NLevel;
+                if (r < 0.0)
+                    break;
+            }
+            int cb, ce;
+            octree.Cell(i0, level, cb, ce);
+            while (ce - cb < NSample && level > 0)
+                octree.Cell(i0, --level, cb, ce);
+            if (ce - cb < NSample)
+                continue;
+            int i1, i2;
+            std::uniform_int_distribution<int> inCell(cb, ce - 1);
+            do { i1 = inCell(randomEngine); } while (i1 == i0);
+            do { i2 = inCell(randomEngine); } while (i2 == i0 || i2 == i1);
+            const int s[NSample] = { octree.pts[i0], octree.pts[i1], octree.pts[i2] };
+            const vcg::Point3f &p0 = pointList[s[0]], &p1 = pointList[s[1]], &p2 = pointList[s[2]];
+
+            std::vector<ERansacCandidate> drawn;
+            // Plane by 3 points
+            vcg::Point3f N = (p1 - p0) ^ (p2 - p0);
+            if (N.Norm() > 1e-12) {
+                N.Normalize();
+                bool good = true;
+                for (int k = 0; k < NSample && bHasNorm; ++k)
+                    good = good && abs(N*normList[s[k]]) > cosTAng*normList[s[k]].Norm();
+                if (good) {
+                    ERansacCandidate c;
+                    c.type = Pt_OnPlane;
+                    c.plane.Set(N, N*p0);
+                    drawn.push_back(c);
+                }
+            }
+            // Cylinder by 2 points with normals, verified by the 3rd
+            if (bCylinder) {
+                ObjCylinder *cyl = EstCylinderTwoPoint(p0, normList[s[0]], p1, normList[s[1]]);
+                if (cyl != 0) {
+                    ERansacCandidate c;
+                    c.type = Pt_OnCylinder;
+                    c.O = cyl->m_O;
+                    c.N = cyl->m_N;
+                    c.N.Normalize();
+                    c.radius = cyl->m_radius;
+                    const bool good =
+                        ERansacInlier(c, p2, &normList[s[2]], TDis, cosTAng) &&
+                        (constriantBox == 0 || (constriantBox->IsIn(c.O) && c.radius <= MaxR / 2.0));
+                    if (good)
+                        drawn.push_back(c);
+                    delete cyl;
+                }
+            }
+            for (int k = 0; k < drawn.size(); ++k) {
+                ERansacCandidate &c = drawn[k];
+                c.level = level;
+                c.nEval = 0;
+                c.score = 0;
+                nEvalPts += ERansacScore(c, FirstSubset(), order, pointList, normList, TDis, cosTAng);
+                levelScore[level] += c.Expected(NRemain) / NRemain;
+                levelDraws[level] += 1.0;
+                pool.push_back(c);
+            }
+        }
+
+        // -- Drop Hopeless Candidates
+        for (int i = pool.size() - 1; i >= 0; --i) {
+            double lo, hi;
+            pool[i].Bounds(NRemain, lo, hi);
+            if (hi < MinSupport(pool[i]))
+                pool.erase(pool.begin() + i);
+        }
+        if (pool.size() > MaxCandidates) {
+            std::vector<std::pair<double, int>> rank(pool.size());
+            for (int i = 0; i < pool.size(); ++i) {
+                double lo, hi;
+                pool[i].Bounds(NRemain, lo, hi);
+                rank[i] = std::pair<double, int>(-hi, i);
+            }
+            std::sort(rank.begin(), rank.end());
+            std::vector<ERansacCandidate> kept(MaxCandidates);
+            for (int i = 0; i < MaxCandidates; ++i)
+                kept[i] = pool[rank[i].second];
+            pool.swap(kept);
+        }
+
+        // -- Select The Best, Refine Its Rivals Until The Intervals Separate
+        int best = -1;
+        while (!pool.empty()) {
+            best = -1;
+            for (int i = 0; i < pool.size(); ++i) {
+                const double E = pool[i].Expected(NRemain);
+                if (E >= MinSupport(pool[i]) && (best < 0 || E > pool[best].Expected(NRemain)))
+                    best = i;
+            }
+            if (best < 0)
+                break;
+            double bestLo, bestHi;
+            pool[best].Bounds(NRemain, bestLo, bestHi);
+            bool refined = false;
+            for (int i = 0; i < pool.size(); ++i) {
+                double lo, hi;
+                pool[i].Bounds(NRemain, lo, hi);
+                if (i == best || hi <= bestLo || pool[i].nEval >= NRemain)
+                    continue;
+                nEvalPts += ERansacScore(pool[i], std::min(NRemain, pool[i].nEval * 2), order, pointList, normList, TDis, cosTAng);
+                refined = true;
+            }
+            if (!refined)
+                break;
+            if (pool[best].nEval < NRemain)
+                nEvalPts += ERansacScore(pool[best], std::min(NRemain, pool[best].nEval * 2), order, pointList, normList, TDis, cosTAng);
+        }
+
+        // -- Extract OR Draw More
+        const double PMin = 1.0 - pow(1.0 - DrawProbability(TMinSupport), nDraw);
+        if (best < 0) {
+            if (PMin > Probability)
+                break;
+            continue;
+        }
+        const double PBest = 1.0 - pow(1.0 - DrawProbability(pool[best].Expected(NRemain)), nDraw);
+        if (PBest <= Probability)
+            continue;
+
+        ERansacCandidate c = pool[best];
+        pool.erase(pool.begin() + best);
+        std::vector<int> verList;
+        double err = ERansacExtract(c, verList, order, pointList, normList, TDis, cosTAng);
+        const bool bGoodSize = (c.type == Pt_OnPlane) ||
+            constriantBox == 0 || c.radius <= MaxR / 2.0;
+        if (verList.size() < MinSupport(c) || !bGoodSize) {
+            flog("    >> Discard a %s candidate with [ %d < %d ] connected points ...\n",
+                c.type == Pt_OnPlane ? "plane" : "cylinder", verList.size(), MinSupport(c));
+            if (++nFailure > MaxFailure)
+                break;
+            continue;
+        }
+
+        ERansacShape shape;
+        shape.type = c.type;
+        shape.plane = c.plane;
+        shape.O = c.O;
+        shape.N = c.N;
+        shape.radius = c.radius;
+        shape.err = err;
+        shape.verList.swap(verList);
+        if (c.type == Pt_OnPlane)
+            nPlane++;
+        else
+            nCylinder++;
+        flog("    >> Extract the [ No.%d ] shape as a %s with [ %d ] points at level [ %d ] after [ %d ] draws ...\n",
+            shapes.size() + 1, c.type == Pt_OnPlane ? "plane" : "cylinder", shape.verList.size(), c.level, nDraw);
+
+        // -- Remove Its Points, The Random Order Is Kept
+        for (int i = 0; i < shape.verList.size(); ++i)
+            removed[shape.verList[i]] = 1;
+        shapes.push_back(shape);
+        int n = 0;
+        for (int i = 0; i < order.size(); ++i) {
+            if (!removed[order[i]])
+                order[n++] = order[i];
+        }
+        order.resize(n);
+        octree.Remove(removed);
+
+        // -- Rescore The Pool On The Remaining Points
+        for (int i = pool.size() - 1; i >= 0; --i) {
+            pool[i].nEval = 0;
+            pool[i].score = 0;
+            nEvalPts += ERansacScore(pool[i], FirstSubset(), order, pointList, normList, TDis, cosTAng);
+            double lo, hi;
+            pool[i].Bounds(order.size(), lo, hi);
+            if (hi < MinSupport(pool[i]))
+                pool.erase(pool.begin() + i);
+        }
+    }
+
+    flog(
+        "      [--ERansac--]: #nPts-%d\n"
+        "        | #Min_Plane    : %d\n"
+        "        | #Min_Cylinder : %d\n"
+        "        | #Draws        : %d\n"
+        "        | #EvalPts      : %lld\n"
+        "        | #Planes       : %d\n"
+        "        | #Cylinders    : %d\n"
+        "        | #Remain       : %d\n"
+        "      [--ERansac--]: Done in %.4f seconds. \n",
+        NPts, TNPtsPlane, bCylinder ? TNPtsCylinder : 0,
+        nDraw, nEvalPts, nPlane, nCylinder, order.size(),
+        time.elapsed() / 1000.0);
+
+    return shapes.size();
+}
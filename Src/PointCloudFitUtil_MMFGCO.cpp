@@ -1,5 +1,7 @@
 #include "PointCloudFitUtil.h"
+#include "gco/GCoptimization.h"
 #include <vcg/space/index/kdtree/kdtree.h>
+#include <algorithm>
 
 
 ////////////////////////////////////////////////
@@ -18,86 +20,799 @@ MPFGCONeighbors MPFGCOParseNeighbors(
     const int numNeighbors,
     const double unit_a)
 {
+    QTime time;
+    time.start();
+
     const int NVert = mesh.vert.size();
     const int NPts = ptIndex.size();
 
-    int *NeiCount = new int[NPts];
-    int *_NeiIndex = new int[NPts*numNeighbors];
-    int **NeiIndex = new int*[NPts];
-    int *_NeiWeight = new int[NPts*numNeighbors];
-    int **NeiWeight = new int*[NPts];
-    for (int i = 0; i < NPts; ++i) {
-        NeiCount[i] = 0;
-        NeiIndex[i] = _NeiIndex + i*numNeighbors;
-        NeiWeight[i] = _NeiWeight + i*numNeighbors;
-    }
+    // [numNeighbors] slots of each site, compacted to CSR afterwards
+    std::vector<int> NeiCount(NPts, 0);
+    std::vector<int> _NeiIndex((size_t)NPts*numNeighbors, 0);
+    std::vector<int> _NeiWeight((size_t)NPts*numNeighbors, 0);
 
     //--------------
 
-    int *indexMap = new int[NVert];
-    for (int i = 0; i < NVert; ++i)
-        indexMap[i] = -1;
+    std::vector<int> indexMap(NVert, -1);
     for (int i = 0; i < NPts; ++i) {
         assert(ptIndex[i] < NVert);
         indexMap[ptIndex[i]] = i;
     }
     vcg::VertexConstDataWrapper<CMeshO> ww(mesh);
     vcg::KdTree<float> KDTree(ww);
-    vcg::KdTree<float>::PriorityQueue queue;
     const int knnNum = numNeighbors * 2 > 5 ? numNeighbors * 2 : 5;
     const double _r = -1.0 / 2 * (unit_a*unit_a)*(delta*delta);
     CMeshO::VertexIterator vi = mesh.vert.begin();
-    for (int i = 0; i < NPts; ++i) {
-        vcg::Point3f p = (vi + ptIndex[i])->cP();
-        KDTree.doQueryK(p, knnNum, queue);
-        int neiNumQuery = queue.getNofElements();
-        int neiNum = 0;
-        for (int k = 0; k < neiNumQuery; k++) {
-            int neightId = queue.getIndex(k);
-            if ((vi + neightId)->IsD() ||
-                indexMap[neightId] == -1)
-                continue;
-            // Vpq(lp,lq) = w_{p,q}*d_{lp,lq}
-            // d_{lp,lq} = 1 if lp != lq, otherwise 0; 
-            // (see implement of smooth cost in function MPFGCOGeneratCost())
-            // w_{p,q} = lambda * exp{ - (||p-q||_2/a) ^ 2 / 2*delta^2}
-            double w_pq = vcg::SquaredDistance(p, (vi + neightId)->cP());
-            w_pq = lambda *exp(w_pq*_r);
-
-            assert(indexMap[neightId] != -1);
-            NeiIndex[i][neiNum] = indexMap[neightId];
-            NeiWeight[i][neiNum] = int(w_pq + 0.5);
-            neiNum++;
-            if (neiNum >= numNeighbors)
-                break;
+#ifdef _USE_OPENMP_
+#pragma omp parallel
+#endif // !_USE_OPENMP_
+    {
+        vcg::KdTree<float>::PriorityQueue queue;
+#ifdef _USE_OPENMP_
+#pragma omp for schedule(static)
+#endif // !_USE_OPENMP_
+        for (int i = 0; i < NPts; ++i) {
+            vcg::Point3f p = (vi + ptIndex[i])->cP();
+            KDTree.doQueryK(p, knnNum, queue);
+            int *NeiIndex = _NeiIndex.data() + (size_t)i*numNeighbors;
+            int *NeiWeight = _NeiWeight.data() + (size_t)i*numNeighbors;
+            int neiNumQuery = queue.getNofElements();
+            int neiNum = 0;
+            for (int k = 0; k < neiNumQuery; k++) {
+                int neightId = queue.getIndex(k);
+                if ((vi + neightId)->IsD() ||
+                    indexMap[neightId] == -1)
+                    continue;
+                // Vpq(lp,lq) = w_{p,q}*d_{lp,lq}
+                // d_{lp,lq} = 1 if lp != lq, otherwise 0; 
+                // (Potts, see GCoptimization::setSmoothCostPotts())
+                // w_{p,q} = lambda * exp{ - (||p-q||_2/a) ^ 2 / 2*delta^2}
+                double w_pq = vcg::SquaredDistance(p, (vi + neightId)->cP());
+                w_pq = lambda *exp(w_pq*_r);
+
+                assert(indexMap[neightId] != -1);
+                NeiIndex[neiNum] = indexMap[neightId];
+                NeiWeight[neiNum] = int(w_pq + 0.5);
+                neiNum++;
+                if (neiNum >= numNeighbors)
+                    break;
+            }
+            NeiCount[i] = neiNum;
         }
-        NeiCount[i] = neiNum;
     }
-    delete[] indexMap;
+    std::vector<int>().swap(indexMap);
 
     //--------------
 
     MPFGCONeighbors gcoNei;
     gcoNei.numNeighbor = numNeighbors;
     gcoNei.numSite = NPts;
-    gcoNei.neighborsCounts = NeiCount;
-    gcoNei.neighborsIndexes = NeiIndex;
-    gcoNei.neighborsWeights = NeiWeight;
+    gcoNei.ptIndex = ptIndex;
+    gcoNei.lambda = lambda;
+    gcoNei.delta = delta;
+    gcoNei.unitA = unit_a;
+    gcoNei.offsets.resize(NPts + 1);
+    gcoNei.offsets[0] = 0;
+    for (int i = 0; i < NPts; ++i)
+        gcoNei.offsets[i + 1] = gcoNei.offsets[i] + NeiCount[i];
+    gcoNei.indices.resize(gcoNei.offsets[NPts]);
+    gcoNei.weights.resize(gcoNei.offsets[NPts]);
+#ifdef _USE_OPENMP_
+#pragma omp parallel for schedule(static)
+#endif // !_USE_OPENMP_
+    for (int i = 0; i < NPts; ++i) {
+        std::copy_n(_NeiIndex.begin() + (size_t)i*numNeighbors, NeiCount[i], gcoNei.indices.begin() + gcoNei.offsets[i]);
+        std::copy_n(_NeiWeight.begin() + (size_t)i*numNeighbors, NeiCount[i], gcoNei.weights.begin() + gcoNei.offsets[i]);
+    }
 
 #if defined(_ReportOut_)
-    reportMat<int>(_NeiWeight, NPts, numNeighbors, "../~NeighborWeight~.txt");
+    reportMat<int>(_NeiWeight.data(), NPts, numNeighbors, "../~NeighborWeight~.txt");
 #endif
 
+    flog(
+        "      [--MMFGCONeighbors--]: #nPts-%d\n"
+        "        | #KNN    : %d\n"
+        "        | #Edges  : %d\n"
+        "      [--MMFGCONeighbors--]: Done in %.4f seconds. \n",
+        NPts, numNeighbors, gcoNei.offsets[NPts],
+        time.elapsed() / 1000.0);
+
     return gcoNei;
 }
 
+// Angle cost Cost(ang) of ang = CheckAng00(VCGAngle(a, b)) in degree without acos,
+// Cost MUST be non-decreasing in ang. The cost steps up at angles ang_k, i.e. when
+// cos^2(a, b) falls below cos^2(ang_k), and is looked up by the quantized cos^2;
+// cosines within [eps] of a step fall back to the exact formula, so the costs are
+// bit-identical to Cost(CheckAng00(VCGAngle(a, b))).
+template<class CostFn>
+struct MMFGCOAngCost {
+    CostFn Cost;
+    int cost0;                 // cost of the parallel vectors
+    int costPerp;              // cost of the perpendicular vectors (exact)
+    std::vector<double> lo2;   // cos^2 clearly below the k-th step
+    std::vector<double> hi2;   // cos^2 clearly above the k-th step, decreasing
+    bool bExactOnly;           // steps closer than [2*eps], always use the exact formula
+    std::vector<int> table;    // cost of cos^2 in [q, q+1)/NTable, -1 if a step is inside
+    static const int NTable = 4096;
+
+    MMFGCOAngCost(CostFn fn, const double eps = 1e-5) : Cost(fn) {
+        cost0 = Cost(0.0);
+        costPerp = Cost(CheckAng00(VCGAngle(vcg::Point3f(1, 0, 0), vcg::Point3f(0, 1, 0))));
+        for (int k = cost0 + 1; k <= Cost(90.0); ++k) {
+            // The smallest angle with [Cost >= k]
+            double lo = 0.0, hi = 90.0;
+            for (int it = 0; it < 64; ++it) {
+                const double mid = (lo + hi) / 2.0;
+                if (Cost(mid) >= k) hi = mid;
+                else lo = mid;
+            }
+            const double c = cos(hi / _R2D);
+            lo2.push_back(c > eps ? (c - eps)*(c - eps) : 0.0);
+            hi2.push_back((c + eps)*(c + eps));
+        }
+        bExactOnly = false;
+        for (int k = 0; k + 1 < hi2.size(); ++k)
+            bExactOnly = bExactOnly || lo2[k] < hi2[k + 1];
+
+        table.resize(NTable);
+        for (int q = 0; q < NTable; ++q) {
+            const double c2lo = double(q) / NTable;
+            const double c2hi = double(q + 1) / NTable;
+            int m = 0;
+            bool inside = false;
+            for (int k = 0; k < hi2.size(); ++k) {
+                inside = inside || (c2lo < hi2[k] && hi2[k] < c2hi);
+                if (hi2[k] >= c2hi)
+                    m++;
+            }
+            table[q] = (inside || (m > 0 && c2hi > lo2[m - 1])) ? -1 : cost0 + m;
+        }
+    }
+    int operator()(const vcg::Point3f &a, const vcg::Point3f &b) const {
+        const double ab = a*b;
+        const double nn = double(a.SquaredNorm())*b.SquaredNorm();
+        if (nn > 1e-30 && !bExactOnly) {
+            if (ab == 0.0)
+                return costPerp;
+            const double c2 = ab*ab / nn;
+            const int cost = table[std::min(int(c2*NTable), NTable - 1)];
+            if (cost >= 0)
+                return cost;
+            // [m] steps are passed, i.e. c2 < hi2[k] for all k < m
+            int m = 0, e = hi2.size();
+            while (m < e) {
+                const int mid = (m + e) / 2;
+                if (c2 < hi2[mid]) m = mid + 1;
+                else e = mid;
+            }
+            if (m == 0 || c2 <= lo2[m - 1])
+                return cost0 + m;
+        }
+        return Cost(CheckAng00(VCGAngle(a, b)));
+    }
+};
+template<class CostFn>
+static MMFGCOAngCost<CostFn> MMFGCOMakeAngCost(CostFn fn) { return MMFGCOAngCost<CostFn>(fn); }
+
+// Data cost of [NLabel] labels (0 is the noise label) over [NPts] sites,
+// Dis(l, j) is the distance of site j to label l in unit a, Ang(l, j) the angle cost.
+// band > 0 : sparse, label l is only feasible for the sites closer than [band],
+// band = 0 : dense [NPts*NLabel] matrix.
+// The sites are filled in parallel, site by site in blocks (dense) or chunks (sparse).
+template<class DisFn, class AngFn>
+static void MPFGCOFillDataCost(
+    MPFGCOCost &gcoCost,
+    const int NPts, const int NLabel,
+    const int cost_noise, const double band,
+    DisFn Dis, AngFn Ang)
+{
+    QTime time;
+    time.start();
+
+    long long NPairs = (long long)NPts*NLabel;
+    long long NSaturated = 0;
+    if (band <= 0.0) {
+        // [Block*NLabel] costs are whole cache lines for any NLabel
+        const int Block = 64;
+        const int NBlock = (NPts + Block - 1) / Block;
+        MPFGCODataCost *DataCost = new MPFGCODataCost[(size_t)NPts*NLabel];
+#ifdef _USE_OPENMP_
+#pragma omp parallel for schedule(static) reduction(+:NSaturated)
+#endif // !_USE_OPENMP_
+        for (int b = 0; b < NBlock; ++b) {
+            const int jEnd = std::min(NPts, (b + 1)*Block);
+            for (int j = b*Block; j < jEnd; ++j) {
+                MPFGCODataCost *row = DataCost + (size_t)j*NLabel;
+                row[0] = MPFGCODataCost(std::min(cost_noise, MPFGCODataCostMax));
+                for (int i = 1; i < NLabel; ++i) {
+                    // far sites are saturated (also keeps the int conversion in range)
+                    const double d = Dis(i, j);
+                    const int cost = d < MPFGCODataCostMax ? int(d + 0.5) + Ang(i, j) : MPFGCODataCostMax;
+                    if (cost >= MPFGCODataCostMax)
+                        NSaturated++;
+                    row[i] = MPFGCODataCost(std::min(cost, MPFGCODataCostMax));
+                }
+            }
+        }
+        gcoCost.dataCost = DataCost;
+    }
+    else {
+        // (site, cost) pairs of each chunk label by label, then gathered in site order
+        const int Chunk = 4096;
+        const int NChunk = (NPts + Chunk - 1) / Chunk;
+        std::vector<std::vector<int>> chunkPairs((size_t)NChunk*NLabel);
+#ifdef _USE_OPENMP_
+#pragma omp parallel for schedule(dynamic)
+#endif // !_USE_OPENMP_
+        for (int c = 0; c < NChunk; ++c) {
+            std::vector<int> *local = &chunkPairs[(size_t)c*NLabel];
+            const int jEnd = std::min(NPts, (c + 1)*Chunk);
+            for (int j = c*Chunk; j < jEnd; ++j) {
+                for (int i = 1; i < NLabel; ++i) {
+                    const double d = Dis(i, j);
+                    if (d >= band)
+                        continue;
+                    local[i].push_back(j);
+                    local[i].push_back(int(d + 0.5) + Ang(i, j));
+                }
+            }
+        }
+
+        std::vector<int> &pairs = gcoCost.sparseCost;
+        std::vector<int> &counts = gcoCost.sparseCount;
+        counts.assign(NLabel, 0);
+        size_t total = (size_t)NPts * 2;
+        for (size_t k = 0; k < chunkPairs.size(); ++k)
+            total += chunkPairs[k].size();
+        pairs.reserve(total);
+        for (int j = 0; j < NPts; ++j) {
+            pairs.push_back(j);
+            pairs.push_back(cost_noise);
+        }
+        counts[0] = NPts;
+        for (int i = 1; i < NLabel; ++i) {
+            for (int c = 0; c < NChunk; ++c) {
+                std::vector<int> &local = chunkPairs[(size_t)c*NLabel + i];
+                pairs.insert(pairs.end(), local.begin(), local.end());
+                counts[i] += local.size() / 2;
+                std::vector<int>().swap(local);
+            }
+        }
+        NPairs = pairs.size() / 2;
+    }
+
+    flog(
+        "      [--MMFGCOCost--]: #nPts-%d\n"
+        "        | #Label  : %d\n"
+        "        | #Mode   : %s\n"
+        "        | #Band   : %.2f\n"
+        "        | #Pairs  : %lld ( %.2f%% of dense )\n"
+        "        | #Cost   : %d bits, %lld saturated\n"
+        "      [--MMFGCOCost--]: Done in %.4f seconds. \n",
+        NPts, NLabel,
+        band > 0.0 ? "Sparse" : "Dense", band,
+        NPairs, NPts*NLabel > 0 ? 100.0*NPairs / ((long long)NPts*NLabel) : 0.0,
+        band > 0.0 ? int(8 * sizeof(int)) : int(8 * sizeof(MPFGCODataCost)), NSaturated,
+        time.elapsed() / 1000.0);
+}
+void MPFGCOSetDataCost(GCoptimization *gco, const MPFGCOCost &gcoCost)
+{
+    if (gcoCost.sparseCount.empty()) {
+        gco->setDataCost(gcoCost.dataCost);
+        return;
+    }
+    static_assert(sizeof(GCoptimization::SparseDataCost) == 2 * sizeof(int),
+        "MPFGCOCost::sparseCost MUST be laid out as GCoptimization::SparseDataCost");
+    GCoptimization::SparseDataCost *pairs =
+        (GCoptimization::SparseDataCost*)(gcoCost.sparseCost.data());
+    for (int l = 0, offset = 0; l < gcoCost.numLabel; ++l) {
+        gco->setDataCost(l, pairs + offset, gcoCost.sparseCount[l]);
+        offset += gcoCost.sparseCount[l];
+    }
+}
+
+void MMFGCOSession::setNeighbors(const MPFGCONeighbors &nei)
+{
+    memRelease();
+    neighbors = &nei;
+    labels.assign(nei.numSite, 0);
+
+    const int NPts = nei.numSite;
+    m_counts.resize(NPts);
+    m_rowIndexes.resize(NPts);
+    m_rowWeights.resize(NPts);
+    int *indices = const_cast<int*>(nei.indices.data());
+    int *weights = const_cast<int*>(nei.weights.data());
+    for (int i = 0; i < NPts; ++i) {
+        m_counts[i] = nei.offsets[i + 1] - nei.offsets[i];
+        m_rowIndexes[i] = indices + nei.offsets[i];
+        m_rowWeights[i] = weights + nei.offsets[i];
+    }
+}
+
+void MMFGCOSession::dropModel(const int i)
+{
+    for (int k = 0; k < labels.size(); ++k) {
+        if (labels[k] == i + 1)
+            labels[k] = 0;
+        else if (labels[k] > i + 1)
+            labels[k]--;
+    }
+}
+
+void MMFGCOSession::mergeModel(const int from, const int to)
+{
+    for (int k = 0; k < labels.size(); ++k) {
+        if (labels[k] == from + 1)
+            labels[k] = to + 1;
+    }
+    dropModel(from);
+}
+
+void MMFGCOSession::swapModels(const int i, const int j)
+{
+    for (int k = 0; k < labels.size(); ++k) {
+        if (labels[k] == i + 1)
+            labels[k] = j + 1;
+        else if (labels[k] == j + 1)
+            labels[k] = i + 1;
+    }
+}
+
+void MMFGCOSession::setTiles(const std::vector<vcg::Point3f> &points, const int tileSites)
+{
+    QTime time;
+    time.start();
+
+    assert(neighbors != 0 && points.size() == neighbors->numSite);
+    const int NPts = points.size();
+    numTile = 1;
+    m_numColor = 0;
+    std::vector<int>().swap(tiles);
+    std::vector<int>().swap(m_edgeOffsets);
+    std::vector<int>().swap(m_edgeSites);
+    std::vector<int>().swap(m_edgeWeights);
+    std::vector<int>().swap(m_tileColors);
+    if (tileSites <= 0 || NPts <= tileSites)
+        return;
+
+    // -- Bisection along the longest side
+    tiles.assign(NPts, 0);
+    std::vector<int> order(NPts);
+    for (int i = 0; i < NPts; ++i)
+        order[i] = i;
+    std::vector<std::pair<int, int>> ranges(1, std::make_pair(0, NPts));
+    numTile = 0;
+    while (!ranges.empty()) {
+        const int b = ranges.back().first;
+        const int e = ranges.back().second;
+        ranges.pop_back();
+        if (e - b <= tileSites) {
+            for (int k = b; k < e; ++k)
+                tiles[order[k]] = numTile;
+            numTile++;
+            continue;
+        }
+        vcg::Box3f box;
+        for (int k = b; k < e; ++k)
+            box.Add(points[order[k]]);
+        // Cut across the middle half of the longest side where the points are the
+        // sparsest, so that the border does NOT run along a surface (at the median if
+        // one side is empty)
+        const int axis = box.MaxDim();
+        const int NBin = 32;
+        const float binSize = box.Dim()[axis] / NBin;
+        int hist[NBin] = { 0 };
+        for (int k = b; k < e; ++k) {
+            const int bin = binSize > 0.0f ? int((points[order[k]][axis] - box.min[axis]) / binSize) : 0;
+            hist[std::min(std::max(bin, 0), NBin - 1)]++;
+        }
+        int cutBin = NBin / 2;
+        for (int k = NBin / 4; k < NBin * 3 / 4; ++k) {
+            if (hist[k] < hist[cutBin] || (hist[k] == hist[cutBin] && abs(2 * k + 1 - NBin) < abs(2 * cutBin + 1 - NBin)))
+                cutBin = k;
+        }
+        const float mid = box.min[axis] + (cutBin + 0.5f)*binSize;
+        int m = std::partition(order.begin() + b, order.begin() + e,
+            [&points, axis, mid](const int i) { return points[i][axis] < mid; }) - order.begin();
+        if (m == b || m == e) {
+            m = (b + e) / 2;
+            std::nth_element(order.begin() + b, order.begin() + m, order.begin() + e,
+                [&points, axis](const int i, const int j) { return points[i][axis] < points[j][axis]; });
+        }
+        ranges.push_back(std::make_pair(m, e));
+        ranges.push_back(std::make_pair(b, m));
+    }
+
+    // -- Edges counted by GCO, i.e. (i, n) in the list of [i] if n < i
+    const MPFGCONeighbors &nei = *neighbors;
+    m_edgeOffsets.assign(NPts + 1, 0);
+    for (int i = 0; i < NPts; ++i) {
+        for (int k = nei.offsets[i]; k < nei.offsets[i + 1]; ++k) {
+            if (nei.indices[k] < i) {
+                m_edgeOffsets[i + 1]++;
+                m_edgeOffsets[nei.indices[k] + 1]++;
+            }
+        }
+    }
+    for (int i = 0; i < NPts; ++i)
+        m_edgeOffsets[i + 1] += m_edgeOffsets[i];
+    m_edgeSites.resize(m_edgeOffsets[NPts]);
+    m_edgeWeights.resize(m_edgeOffsets[NPts]);
+    std::vector<int> fill(m_edgeOffsets.begin(), m_edgeOffsets.end() - 1);
+    for (int i = 0; i < NPts; ++i) {
+        for (int k = nei.offsets[i]; k < nei.offsets[i + 1]; ++k) {
+            const int n = nei.indices[k];
+            if (n < i) {
+                m_edgeSites[fill[i]] = n;
+                m_edgeWeights[fill[i]++] = nei.weights[k];
+                m_edgeSites[fill[n]] = i;
+                m_edgeWeights[fill[n]++] = nei.weights[k];
+            }
+        }
+    }
+
+    // -- Greedy coloring of the tile graph
+    std::vector<std::vector<int>> adjacent(numTile);
+    for (int i = 0; i < NPts; ++i) {
+        for (int k = m_edgeOffsets[i]; k < m_edgeOffsets[i + 1]; ++k) {
+            const int t = tiles[m_edgeSites[k]];
+            if (t != tiles[i])
+                adjacent[tiles[i]].push_back(t);
+        }
+    }
+    m_tileColors.assign(numTile, -1);
+    for (int t = 0; t < numTile; ++t) {
+        std::vector<char> used(m_numColor + 1, 0);
+        for (int k = 0; k < adjacent[t].size(); ++k) {
+            if (m_tileColors[adjacent[t][k]] >= 0)
+                used[m_tileColors[adjacent[t][k]]] = 1;
+        }
+        int c = 0;
+        while (used[c])
+            c++;
+        m_tileColors[t] = c;
+        m_numColor = std::max(m_numColor, c + 1);
+    }
+
+    flog(
+        "      [--MMFGCOTiles--]: #nPts-%d\n"
+        "        | #Tiles  : %d\n"
+        "        | #Colors : %d\n"
+        "      [--MMFGCOTiles--]: Done in %.4f seconds. \n",
+        NPts, numTile, m_numColor,
+        time.elapsed() / 1000.0);
+}
+
+// Sparse data cost of each group label by label, [nGroup*NLabel] lists of (site, cost)
+// pairs in global site ids, sites out of any group ([group] < 0) are skipped.
+static void MMFGCOGroupPairs(
+    const MPFGCOCost &gcoCost,
+    const std::vector<int> &group, const int nGroup,
+    std::vector<std::vector<int>> &groupPairs)
+{
+    const int NLabel = gcoCost.numLabel;
+    groupPairs.assign((size_t)nGroup*NLabel, std::vector<int>());
+    for (int l = 0, offset = 0; l < gcoCost.sparseCount.size(); ++l) {
+        const int *pairs = gcoCost.sparseCost.data() + 2 * offset;
+        for (int k = 0; k < gcoCost.sparseCount[l]; ++k) {
+            const int g = group[pairs[2 * k]];
+            if (g < 0)
+                continue;
+            groupPairs[(size_t)g*NLabel + l].push_back(pairs[2 * k]);
+            groupPairs[(size_t)g*NLabel + l].push_back(pairs[2 * k + 1]);
+        }
+        offset += gcoCost.sparseCount[l];
+    }
+}
+
+// Alpha-expansion on the sites of group [g] (sorted [sites]) with the others fixed to
+// [labels]: edges to the fixed sites go to the data cost, a label used by the fixed sites
+// ([labelCounts] of all sites) is free, and a new one pays the share of the group only
+// (the full cost would keep the groups from opening any label together).
+// [labels] of the group are updated, return the #changed sites, -1 if GCO failed.
+static int MMFGCOSolveGroup(
+    const MPFGCOCost &gcoCost,
+    const std::vector<int> &edgeOffsets,
+    const std::vector<int> &edgeSites,
+    const std::vector<int> &edgeWeights,
+    const std::vector<int> &group, const int g,
+    const std::vector<int> &sites,
+    const std::vector<int> *groupPairs,
+    const std::vector<int> &labelCounts,
+    const int maxIteration,
+    std::vector<int> &labels)
+{
+    const int NLabel = gcoCost.numLabel;
+    const int n = sites.size();
+    if (n == 0)
+        return 0;
+
+    // -- Inner neighbors & costs of the fixed ones
+    std::vector<int> counts(n, 0);
+    std::vector<int> nbrIndex, nbrWeight;
+    std::vector<int> fixedCost((size_t)n*NLabel, 0);
+    std::vector<int> inner(NLabel, 0);
+    for (int i = 0; i < n; ++i) {
+        const int s = sites[i];
+        inner[labels[s]]++;
+        for (int k = edgeOffsets[s]; k < edgeOffsets[s + 1]; ++k) {
+            const int q = edgeSites[k];
+            if (group[q] == g) {
+                nbrIndex.push_back(std::lower_bound(sites.begin(), sites.end(), q) - sites.begin());
+                nbrWeight.push_back(edgeWeights[k]);
+                counts[i]++;
+            }
+            else {
+                // Potts : every label but the fixed one pays the weight
+                int *row = &fixedCost[(size_t)i*NLabel];
+                for (int l = 0; l < NLabel; ++l)
+                    row[l] += edgeWeights[k];
+                row[labels[q]] -= edgeWeights[k];
+            }
+        }
+    }
+    std::vector<int*> rowIndex(n), rowWeight(n);
+    for (int i = 0, offset = 0; i < n; ++i) {
+        rowIndex[i] = nbrIndex.data() + offset;
+        rowWeight[i] = nbrWeight.data() + offset;
+        offset += counts[i];
+    }
+    std::vector<int> labelCost(NLabel);
+    for (int l = 0; l < NLabel; ++l)
+        labelCost[l] = labelCounts[l] > inner[l] ? 0 : int((double)gcoCost.labelCost*n / labels.size() + 0.5);
+
+    int changed = 0;
+    try {
+        GCoptimizationGeneralGraph gco(n, NLabel);
+        std::vector<int> dense;
+        std::vector<std::vector<int>> sparse;
+        if (gcoCost.sparseCount.empty()) {
+            dense.resize((size_t)n*NLabel);
+            for (int i = 0; i < n; ++i) {
+                for (int l = 0; l < NLabel; ++l)
+                    dense[(size_t)i*NLabel + l] =
+                        gcoCost.dataCost[(size_t)sites[i] * NLabel + l] + fixedCost[(size_t)i*NLabel + l];
+            }
+            gco.setDataCost(dense.data());
+        }
+        else {
+            sparse.resize(NLabel);
+            for (int l = 0; l < NLabel; ++l) {
+                const std::vector<int> &pairs = groupPairs[l];
+                std::vector<int> &local = sparse[l];
+                local.resize(pairs.size());
+                for (int k = 0, i = 0; k < pairs.size(); k += 2) {
+                    while (sites[i] < pairs[k])
+                        i++;
+                    local[k] = i;
+                    local[k + 1] = pairs[k + 1] + fixedCost[(size_t)i*NLabel + l];
+                }
+                gco.setDataCost(l, (GCoptimization::SparseDataCost*)local.data(), local.size() / 2);
+            }
+        }
+        gco.setSmoothCostPotts();
+        gco.setLabelCost(labelCost.data());
+        gco.setAllNeighbors(counts.data(), rowIndex.data(), rowWeight.data());
+        for (int i = 0; i < n; ++i) {
+            if (labels[sites[i]] != 0)
+                gco.setLabel(i, labels[sites[i]]);
+        }
+        gco.setLabelOrder(false);
+        gco.setVerbosity(0);
+        gco.expansion(maxIteration);
+        for (int i = 0; i < n; ++i) {
+            const int l = gco.whatLabel(i);
+            if (l != labels[sites[i]]) {
+                labels[sites[i]] = l;
+                changed++;
+            }
+        }
+    }
+    catch (GCException e) {
+        return -1;
+    }
+    return changed;
+}
+
+bool MMFGCOSession::partitionedExpansion(const MPFGCOCost &gcoCost, const int maxIteration, long long &tileEnergy)
+{
+    const int NPts = gcoCost.numSite;
+    const int NLabel = gcoCost.numLabel;
+    const int maxSweep = 2;
+
+    std::vector<std::vector<int>> tileSites(numTile);
+    for (int i = 0; i < NPts; ++i)
+        tileSites[tiles[i]].push_back(i);
+    std::vector<std::vector<int>> tilePairs;
+    if (!gcoCost.sparseCount.empty())
+        MMFGCOGroupPairs(gcoCost, tiles, numTile, tilePairs);
+    else
+        tilePairs.resize((size_t)numTile*NLabel);
+
+    // -- Tiles of a color in parallel, colors in turn
+    int failures = 0;
+    for (int sweep = 0; sweep < maxSweep && failures == 0; ++sweep) {
+        int changed = 0;
+        for (int c = 0; c < m_numColor; ++c) {
+            std::vector<int> labelCounts(NLabel, 0);
+            for (int i = 0; i < NPts; ++i)
+                labelCounts[labels[i]]++;
+            std::vector<int> colorTiles;
+            for (int t = 0; t < numTile; ++t) {
+                if (m_tileColors[t] == c)
+                    colorTiles.push_back(t);
+            }
+            const int NColorTile = colorTiles.size();
+#ifdef _USE_OPENMP_
+#pragma omp parallel for schedule(dynamic) reduction(+:changed, failures)
+#endif // !_USE_OPENMP_
+            for (int k = 0; k < NColorTile; ++k) {
+                const int t = colorTiles[k];
+                const int _changed = MMFGCOSolveGroup(
+                    gcoCost, m_edgeOffsets, m_edgeSites, m_edgeWeights,
+                    tiles, t, tileSites[t], &tilePairs[(size_t)t*NLabel],
+                    labelCounts, maxIteration, labels);
+                if (_changed < 0)
+                    failures++;
+                else
+                    changed += _changed;
+            }
+        }
+        if (changed == 0)
+            break;
+    }
+    if (failures > 0)
+        return false;
+    for (int i = 0; i < NPts; ++i)
+        m_gco->setLabel(i, labels[i]);
+    tileEnergy = m_gco->compute_energy();
+
+    // -- Reconcile the border band (sites with an edge across tiles)
+    std::vector<int> band(NPts, -1);
+    std::vector<int> bandSites;
+    for (int i = 0; i < NPts; ++i) {
+        for (int k = m_edgeOffsets[i]; k < m_edgeOffsets[i + 1]; ++k) {
+            if (tiles[m_edgeSites[k]] != tiles[i]) {
+                band[i] = 0;
+                bandSites.push_back(i);
+                break;
+            }
+        }
+    }
+    std::vector<std::vector<int>> bandPairs;
+    if (!gcoCost.sparseCount.empty())
+        MMFGCOGroupPairs(gcoCost, band, 1, bandPairs);
+    else
+        bandPairs.resize(NLabel);
+    std::vector<int> labelCounts(NLabel, 0);
+    for (int i = 0; i < NPts; ++i)
+        labelCounts[labels[i]]++;
+    return MMFGCOSolveGroup(
+        gcoCost, m_edgeOffsets, m_edgeSites, m_edgeWeights,
+        band, 0, bandSites, bandPairs.data(),
+        labelCounts, maxIteration, labels) >= 0;
+}
+
+void MMFGCOSession::expansion(const MPFGCOCost &gcoCost, const int maxIteration, const bool bRandomOrder)
+{
+    QTime time;
+    time.start();
+
+    const int NPts = gcoCost.numSite;
+    const int NLabel = gcoCost.numLabel;
+    assert(neighbors != 0 && NPts == neighbors->numSite);
+    if (!bWarmStart || labels.size() != NPts)
+        labels.assign(NPts, 0);
+
+    // -- Seeds MUST be feasible (the noise label is always feasible)
+    std::vector<char> feasible(NPts, gcoCost.sparseCount.empty() ? 1 : 0);
+    for (int l = 0, offset = 0; l < gcoCost.sparseCount.size(); ++l) {
+        const int *pairs = gcoCost.sparseCost.data() + 2 * offset;
+        for (int k = 0; k < gcoCost.sparseCount[l]; ++k) {
+            if (labels[pairs[2 * k]] == l)
+                feasible[pairs[2 * k]] = 1;
+        }
+        offset += gcoCost.sparseCount[l];
+    }
+    int numSeed = 0;
+    for (int i = 0; i < NPts; ++i) {
+        if (labels[i] >= NLabel || !feasible[i])
+            labels[i] = 0;
+        if (labels[i] != 0)
+            numSeed++;
+    }
+
+    // -- Solve (the neighbor system is shared, NOT copied by GCO)
+    if (m_gco)
+        delete m_gco;
+    m_gco = new GCoptimizationGeneralGraph(NPts, NLabel);
+    MPFGCOSetDataCost(m_gco, gcoCost);
+    m_gco->setSmoothCostPotts();
+    m_gco->setLabelCost(gcoCost.labelCost);
+    m_gco->setAllNeighbors(m_counts.data(), m_rowIndexes.data(), m_rowWeights.data());
+    for (int i = 0; i < NPts; ++i) {
+        if (labels[i] != 0)
+            m_gco->setLabel(i, labels[i]);
+    }
+    m_gco->setLabelOrder(bRandomOrder);
+    m_gco->setVerbosity(1);
+    long long energy = 0;
+    bool bTiled = numTile > 1 && tiles.size() == NPts;
+    bool bPolished = false;
+    if (bTiled) {
+        // -- Partitioned, kept only if NOT worse than the seeds
+        const double PolishTolerance = 1e-2;
+        const long long seedEnergy = m_gco->compute_energy();
+        std::vector<int> seeds = labels;
+        long long tileEnergy = 0;
+        const bool bDone = partitionedExpansion(gcoCost, maxIteration, tileEnergy);
+        for (int i = 0; i < NPts; ++i)
+            m_gco->setLabel(i, labels[i]);
+        energy = m_gco->compute_energy();
+        if (!bDone || energy > seedEnergy) {
+            flog("    >> [ ): ] Partitioned expansion failed OR raised the energy, fall back to the sequential one ...\n");
+            labels.swap(seeds);
+            for (int i = 0; i < NPts; ++i)
+                m_gco->setLabel(i, labels[i]);
+            bTiled = false;
+        }
+        else if (tileEnergy - energy > PolishTolerance * std::max(energy, 1LL)) {
+            // -- The band lowered the energy by more than 1%, the tiles disagreed
+            //    across their borders: ONE whole-graph cycle settles them
+            energy = m_gco->expansion(1);
+            bPolished = true;
+        }
+    }
+    if (!bTiled)
+        energy = m_gco->expansion(maxIteration);
+    m_gco->whatLabel(0, NPts, labels.data());
+    delete m_gco;
+    m_gco = 0;
+
+    flog(
+        "      [--MMFGCOSession--]: #nPts-%d\n"
+        "        | #Label  : %d\n"
+        "        | #Seeds  : %d ( %.2f%% )\n"
+        "        | #Mode   : %s\n"
+        "        | #Energy : %lld\n"
+        "      [--MMFGCOSession--]: Done in %.4f seconds. \n",
+        NPts, NLabel,
+        numSeed, NPts > 0 ? 100.0*numSeed / NPts : 0.0,
+        bTiled ? (bPolished ? "Partitioned + 1 full cycle" : "Partitioned") : "Sequential",
+        energy,
+        time.elapsed() / 1000.0);
+}
+
+void MMFGCOSession::memRelease()
+{
+    // GCO refers to the neighbor system, so it goes first
+    if (m_gco)
+        delete m_gco;
+    m_gco = 0;
+    neighbors = 0;
+    std::vector<int>().swap(m_counts);
+    std::vector<int*>().swap(m_rowIndexes);
+    std::vector<int*>().swap(m_rowWeights);
+    std::vector<int>().swap(labels);
+    numTile = 1;
+    m_numColor = 0;
+    std::vector<int>().swap(tiles);
+    std::vector<int>().swap(m_edgeOffsets);
+    std::vector<int>().swap(m_edgeSites);
+    std::vector<int>().swap(m_edgeWeights);
+    std::vector<int>().swap(m_tileColors);
+}
+
 MPFGCOCost MPFGCOGeneratCost(
     const std::vector<vcg::Plane3f> &planes,
     const std::vector<vcg::Point3f> &points,
     const std::vector<vcg::Point3f> &norms,
     const double unit_a,
     const int cost_noise,
-    const int cost_label)
+    const int cost_label,
+    const double band)
 {
     const bool bHasNorm = norms.empty() ? false : true;
     if (bHasNorm)
@@ -105,6 +820,7 @@ MPFGCOCost MPFGCOGeneratCost(
 
     const double angCost = 15.0;
     const double angr = 1.0 / (angCost*angCost);
+    auto AngCost = MMFGCOMakeAngCost([=](const double ang) { return int(ang*ang*angr); });
 
     const int NPts = points.size();
     const int NPlane = planes.size();
@@ -112,47 +828,29 @@ MPFGCOCost MPFGCOGeneratCost(
     // Data Energy
     // Dp(lp) = ||p-lp||_2 / a + [(p,lp)/ang]^2,
     // |p-lp||_2 / a : distance form p to lp (the plane) in unit a.
-    int *DataCost = new int[NPts *NLabel];
-    for (int i = 0; i < NPts; ++i)
-        DataCost[i*NLabel] = cost_noise;
-
-    for (int i = 1; i < NLabel; ++i) {
-        vcg::Plane3f ple = planes[i - 1];
-        // Dis
-        for (int j = 0; j < NPts; ++j) {
-            double d = abs(vcg::SignedDistancePlanePoint(ple, points.at(j)));
-            DataCost[j*NLabel + i] = int(d / unit_a + 0.5);
-        }
-        // Ang
-        if (bHasNorm) {
-            for (int j = 0; j < NPts; ++j) {
-                double ang = CheckAng00(VCGAngle(ple.Direction(), norms[j]));
-                DataCost[j*NLabel + i] += int(ang*ang*angr);
-            }
-        }
-    }
+    MPFGCOCost gcoCost;
+    MPFGCOFillDataCost(gcoCost, NPts, NLabel, cost_noise, band,
+        [&](const int i, const int j) {
+            return abs(vcg::SignedDistancePlanePoint(planes[i - 1], points.at(j))) / unit_a;
+        },
+        [&](const int i, const int j) {
+            if (!bHasNorm)
+                return 0;
+            return AngCost(planes[i - 1].Direction(), norms[j]);
+        });
     // Smooth Energy
     // Vpq(lp,lq) = w_{p,q}*d_{lp,lq}
-    // d_{lp,lq} = 1 if lp != lq, otherwise 0; 
+    // d_{lp,lq} = 1 if lp != lq, otherwise 0 (Potts, set up by GCO without a table);
     // w_{p,q} = lambda * exp{ - (||p-q||_2/a) ^ 2 / 2*delta^2}
     // (see implement of neighbor system in function MPFGCOParseNeighbors())
-    int *SmoothCost = new int[NLabel*NLabel];
-    for (int i = 0; i < NLabel; ++i) {
-        for (int j = 0; j < NLabel; ++j)
-            SmoothCost[i*NLabel + j] = 1;
-        SmoothCost[i*NLabel + i] = 0;
-    }
 
-    MPFGCOCost gcoCost;
     gcoCost.numLabel = NLabel;
     gcoCost.numSite = NPts;
-    gcoCost.dataCost = DataCost;
-    gcoCost.smoothCost = SmoothCost;
     gcoCost.labelCost = cost_label;
 
 #if defined(_ReportOut_)
-    reportMat<int>(DataCost, NPts, NLabel, "../~CostData~.txt");
-    reportMat<int>(SmoothCost, NLabel, NLabel, "../~CostSmooth~.txt");
+    if (gcoCost.dataCost != 0)
+        reportMat<MPFGCODataCost>(gcoCost.dataCost, NPts, NLabel, "../~CostData~.txt");
 #endif
 
     return gcoCost;
@@ -163,7 +861,8 @@ MPFGCOCost MPFGCOGeneratCost(
     const std::vector<vcg::Point3f> &norms,
     const double unit_a,
     const int cost_noise,
-    const int cost_label)
+    const int cost_label,
+    const double band)
 {
     const bool bHasNorm = norms.empty() ? false : true;
     if (bHasNorm)
@@ -171,6 +870,7 @@ MPFGCOCost MPFGCOGeneratCost(
 
     const double angCost = 15.0;
     const double angr = 1.0 / angCost;
+    auto AngCost = MMFGCOMakeAngCost([=](const double ang) { return int(ang*angr); });
 
     const int NPts = points.size();
     const int NCylinders = cylinders.size();
@@ -178,47 +878,90 @@ MPFGCOCost MPFGCOGeneratCost(
     // Data Energy
     // Dp(lp) = ||p-lp||_2 / a + [(p,lp)/ang],
     // |p-lp||_2 / a : distance form p to lp (the plane) in unit a.
-    int *DataCost = new int[NPts *NLabel];
-    for (int i = 0; i < NPts; ++i)
-        DataCost[i*NLabel] = cost_noise;
-
-    for (int i = 1; i < NLabel; ++i) {
-        ObjCylinder *cyl = cylinders[i - 1];
-        // Dis
-        for (int j = 0; j < NPts; ++j) {
-            double d = abs(SignedDistanceCylinderPoint(*cyl, points.at(j)));
-            DataCost[j*NLabel + i] = int(d / unit_a + 0.5);
-        }
-        // Ang
-        if (bHasNorm) {
-            for (int j = 0; j < NPts; ++j) {
-                double ang = AngCylinderPoint(*cyl, points.at(j), norms.at(j));
-                DataCost[j*NLabel + i] += int(ang*angr);
-            }
-        }
-    }
+    MPFGCOCost gcoCost;
+    MPFGCOFillDataCost(gcoCost, NPts, NLabel, cost_noise, band,
+        [&](const int i, const int j) {
+            return abs(SignedDistanceCylinderPoint(*cylinders[i - 1], points.at(j))) / unit_a;
+        },
+        [&](const int i, const int j) {
+            if (!bHasNorm)
+                return 0;
+            // Same as AngCylinderPoint()
+            const ObjCylinder &cyl = *cylinders[i - 1];
+            vcg::Point3f op = points.at(j) - cyl.m_O;
+            double l = (op * cyl.m_N) / (cyl.m_N.SquaredNorm());
+            vcg::Point3f np = op - cyl.m_N*l;
+            return AngCost(np, norms.at(j));
+        });
     // Smooth Energy
     // Vpq(lp,lq) = w_{p,q}*d_{lp,lq}
-    // d_{lp,lq} = 1 if lp != lq, otherwise 0; 
+    // d_{lp,lq} = 1 if lp != lq, otherwise 0 (Potts, set up by GCO without a table);
     // w_{p,q} = lambda * exp{ - (||p-q||_2/a) ^ 2 / 2*delta^2}
     // (see implement of neighbor system in function MPFGCOParseNeighbors())
-    int *SmoothCost = new int[NLabel*NLabel];
-    for (int i = 0; i < NLabel; ++i) {
-        for (int j = 0; j < NLabel; ++j)
-            SmoothCost[i*NLabel + j] = 1;
-        SmoothCost[i*NLabel + i] = 0;
-    }
 
+    gcoCost.numLabel = NLabel;
+    gcoCost.numSite = NPts;
+    gcoCost.labelCost = cost_label;
+
+#if defined(_ReportOut_)
+    if (gcoCost.dataCost != 0)
+        reportMat<MPFGCODataCost>(gcoCost.dataCost, NPts, NLabel, "../~CostData~.txt");
+#endif
+
+    return gcoCost;
+}
+MPFGCOCost MPFGCOGeneratCost(
+    const std::vector<vcg::Plane3f> &planes,
+    const std::vector<ObjCylinder*> &cylinders,
+    const std::vector<vcg::Point3f> &points,
+    const std::vector<vcg::Point3f> &norms,
+    const double unit_a,
+    const int cost_noise,
+    const int cost_label,
+    const double band)
+{
+    // Label columns of the two costs are joined, the noise label of the cylinders is dropped
+    MPFGCOCost planeCost = MPFGCOGeneratCost(planes, points, norms, unit_a, cost_noise, cost_label, band);
+    MPFGCOCost cylCost = MPFGCOGeneratCost(cylinders, points, norms, unit_a, cost_noise, cost_label, band);
+
+    const int NPts = points.size();
+    const int NPlaneLabel = planeCost.numLabel;
+    const int NCylLabel = cylCost.numLabel;
+    const int NLabel = NPlaneLabel + NCylLabel - 1;
     MPFGCOCost gcoCost;
+    if (band <= 0.0) {
+        MPFGCODataCost *DataCost = new MPFGCODataCost[(size_t)NPts*NLabel];
+#ifdef _USE_OPENMP_
+#pragma omp parallel for schedule(static)
+#endif // !_USE_OPENMP_
+        for (int j = 0; j < NPts; ++j) {
+            const MPFGCODataCost *planeRow = planeCost.dataCost + (size_t)j*NPlaneLabel;
+            const MPFGCODataCost *cylRow = cylCost.dataCost + (size_t)j*NCylLabel;
+            MPFGCODataCost *row = DataCost + (size_t)j*NLabel;
+            std::copy(planeRow, planeRow + NPlaneLabel, row);
+            std::copy(cylRow + 1, cylRow + NCylLabel, row + NPlaneLabel);
+        }
+        gcoCost.dataCost = DataCost;
+    }
+    else {
+        // Pairs are kept label by label, so the cylinder labels are appended as they are
+        gcoCost.sparseCost.swap(planeCost.sparseCost);
+        gcoCost.sparseCount.swap(planeCost.sparseCount);
+        gcoCost.sparseCost.insert(gcoCost.sparseCost.end(),
+            cylCost.sparseCost.begin() + 2 * cylCost.sparseCount[0], cylCost.sparseCost.end());
+        gcoCost.sparseCount.insert(gcoCost.sparseCount.end(),
+            cylCost.sparseCount.begin() + 1, cylCost.sparseCount.end());
+    }
+    planeCost.memRelease();
+    cylCost.memRelease();
+
     gcoCost.numLabel = NLabel;
     gcoCost.numSite = NPts;
-    gcoCost.dataCost = DataCost;
-    gcoCost.smoothCost = SmoothCost;
     gcoCost.labelCost = cost_label;
 
 #if defined(_ReportOut_)
-    reportMat<int>(DataCost, NPts, NLabel, "../~CostData~.txt");
-    reportMat<int>(SmoothCost, NLabel, NLabel, "../~CostSmooth~.txt");
+    if (gcoCost.dataCost != 0)
+        reportMat<MPFGCODataCost>(gcoCost.dataCost, NPts, NLabel, "../~CostData~.txt");
 #endif
 
     return gcoCost;
@@ -243,18 +986,29 @@ std::vector<double> GCOReEstimat(
         planeVerList[label].push_back(i);
     }
     
+    std::vector<int> fitLabels;
     for (int k = 1; k < NPlane + 1; k++) {
         if (planeVerList[k].size() <= TInlier) {
             flog("    >> Quit the [ No.%d ] plane with [ %d ] points ...\n", k, planeVerList[k].size());
             continue;
         }
         flog("    >> Fine Fit the [ No.%d ] plane ...\n", k);
-        vcg::Plane3f plane;
-        double err = FinePlane(pointList, planeVerList[k], plane);
-        errors.push_back(err);
-        optPlanes.push_back(plane);
+        fitLabels.push_back(k);
     }
 
+    // -- Labels are fitted in parallel, results and logs are kept in label order
+    const int NFit = fitLabels.size();
+    optPlanes.resize(NFit);
+    errors.resize(NFit);
+    std::vector<std::string> fitLogs(NFit);
+#ifdef _USE_OPENMP_
+#pragma omp parallel for schedule(dynamic)
+#endif // !_USE_OPENMP_
+    for (int f = 0; f < NFit; ++f)
+        errors[f] = FinePlane(pointList, planeVerList[fitLabels[f]], optPlanes[f], &fitLogs[f]);
+    for (int f = 0; f < NFit; ++f)
+        flog("%s", fitLogs[f].c_str());
+
     planes.swap(optPlanes);
 
     return errors;
@@ -263,7 +1017,10 @@ std::vector<double> GCOReEstimat(
 std::vector<double> GCOReEstimat(
     std::vector<ObjCylinder*> &cylinders,
     const std::vector<vcg::Point3f> &pointList,
-    const int *labels, const unsigned int TInlier)
+    const int *labels, const unsigned int TInlier,
+    const CylinderFitMode mode,
+    const std::vector<vcg::Point3f> *normList,
+    MCFGCOWarmStart *warmStart)
 {
     std::vector<double> errors;
 
@@ -277,17 +1034,93 @@ std::vector<double> GCOReEstimat(
         int label = labels[i];
         cylinderVerList[label].push_back(i);
     }
+    const bool warm = warmStart != 0 &&
+        warmStart->verLists.size() == NCylinder && warmStart->errors.size() == NCylinder;
+    const double TReuse = warm ? warmStart->TChange*0.1 : -1.0;
+    const double TPolish = warm ? warmStart->TChange : -1.0;
+    std::vector<std::vector<int>> optVerList;
+    std::vector<std::pair<int, CylinderFitMode>> fitJobs;  // < index in optCylinders, mode >
+    int nReused = 0, nPolished = 0, nRefit = 0;
     _ResetObjCode(Pt_OnCylinder);
     for (int k = 1; k < NCylinder + 1; k++) {
         if (cylinderVerList[k].size() <= TInlier) {
             flog("    >> Quit the [ No.%d ] cylinder with [ %d < %d ] points ...\n", k, cylinderVerList[k].size(), TInlier);
             continue;
         }
-        flog("    >> Fine Fit the [ No.%d ] cylinder with [ %d > %d ] points ...\n", k, cylinderVerList[k].size(), TInlier);
+
+        // -- Fraction of changed labels, both lists are in ascending order
+        double change = 1.0;
+        if (warm && !warmStart->verLists[k - 1].empty()) {
+            const std::vector<int> &prev = warmStart->verLists[k - 1];
+            const std::vector<int> &curr = cylinderVerList[k];
+            int nSame = 0;
+            for (int i = 0, j = 0; i < prev.size() && j < curr.size();) {
+                if (prev[i] < curr[j]) i++;
+                else if (prev[i] > curr[j]) j++;
+                else { nSame++; i++; j++; }
+            }
+            change = (prev.size() + curr.size() - 2.0*nSame) / std::max(prev.size(), curr.size());
+        }
+
+        // -- Object codes are taken here in label order, the fits are done later
         double err = 0;
-        ObjCylinder* cylinder = FineCylinder(pointList, cylinderVerList[k], err);
+        ObjCylinder* cylinder = 0;
+        if (change < TReuse) {
+            flog("    >> Reuse the [ No.%d ] cylinder with [ %d > %d ] points [ %.2f%% changed ] ...\n",
+                k, cylinderVerList[k].size(), TInlier, change*100);
+            const ObjCylinder *prev = cylinders.at(k - 1);
+            cylinder = new ObjCylinder(_GetObjCode(Pt_OnCylinder));
+            cylinder->m_O = prev->m_O;
+            cylinder->m_N = prev->m_N;
+            cylinder->m_radius = prev->m_radius;
+            cylinder->m_length = prev->m_length;
+            err = warmStart->errors[k - 1];
+            nReused++;
+        }
+        else if (change < TPolish) {
+            flog("    >> Polish the [ No.%d ] cylinder with [ %d > %d ] points [ %.2f%% changed ] ...\n",
+                k, cylinderVerList[k].size(), TInlier, change*100);
+            cylinder = new ObjCylinder(_GetObjCode(Pt_OnCylinder));
+            cylinder->m_N = cylinders.at(k - 1)->m_N;
+            fitJobs.push_back(std::make_pair(optCylinders.size(), CylinderFit_Polish));
+            nPolished++;
+        }
+        else {
+            flog("    >> Fine Fit the [ No.%d ] cylinder with [ %d > %d ] points ...\n", k, cylinderVerList[k].size(), TInlier);
+            // Seed the axis search with the current model of the label
+            cylinder = new ObjCylinder(_GetObjCode(Pt_OnCylinder));
+            cylinder->m_N = cylinders.at(k - 1)->m_N;
+            fitJobs.push_back(std::make_pair(optCylinders.size(), mode));
+            nRefit++;
+        }
         errors.push_back(err);
         optCylinders.push_back(cylinder);
+        optVerList.push_back(std::vector<int>());
+        optVerList.back().swap(cylinderVerList[k]);
+    }
+    flog("    >> Re-Estimate [ %d ] cylinders: [ %d reused | %d polished | %d refit ] ...\n",
+        optCylinders.size(), nReused, nPolished, nRefit);
+
+    // -- Fit on the shared OpenMP pool. Nested parallelism stays off, so each
+    //    fit runs on one pool thread; a single fit keeps the whole pool for
+    //    its own inner loops. Logs are buffered and emitted in label order.
+    const int NFit = fitJobs.size();
+    std::vector<std::string> fitLogs(NFit);
+#ifdef _USE_OPENMP_
+#pragma omp parallel for schedule(dynamic) if(NFit > 1)
+#endif // !_USE_OPENMP_
+    for (int f = 0; f < NFit; ++f) {
+        ObjCylinder *cylinder = optCylinders[fitJobs[f].first];
+        const vcg::Point3f initAxis = cylinder->m_N;
+        errors[fitJobs[f].first] = FineCylinder(pointList, optVerList[fitJobs[f].first], *cylinder,
+            fitJobs[f].second, &initAxis, normList, &fitLogs[f]);
+    }
+    for (int f = 0; f < NFit; ++f)
+        flog("%s", fitLogs[f].c_str());
+
+    if (warmStart != 0) {
+        warmStart->verLists.swap(optVerList);
+        warmStart->errors = errors;
     }
 
     cylinders.swap(optCylinders);
@@ -2,12 +2,146 @@
 #include "PCA/PCA.h"
 
 // [1] Detect Planes
+// Parameterization of [fix] : 1.0*x + fa*y + fb*z = fc, with x|y|z = V(index1|index2|index3)
+static bool HoughPlaneAxes(const FixedAxis fix, int &index1, int &index2, int &index3)
+{
+    switch (fix)
+    {
+    case FixedAxis_Z: index1 = 2; index2 = 0; index3 = 1; return true; //ZXY
+    case FixedAxis_Y: index1 = 1; index2 = 2; index3 = 0; return true; //YZX
+    case FixedAxis_X: index1 = 0; index2 = 1; index3 = 2; return true; //XYZ
+    default: return false;
+    }
+}
+// Votes of one point, [Vote] gets the offset [c*A*B + a*A + b] of each voted cell.
+// [pN] is 0 without normals, otherwise only the window around the normal is voted:
+// [normAng] <= 0 : every step of the +-0.3 window around the slopes of the normal,
+// [normAng] >  0 : the cells of the slopes of the normal, splatted by the slope
+//                  deviation of a normal deviation of [normAng] (in degree).
+template<class VoteFn>
+static void HoughPlaneVotes(
+    const vcg::Point3f &P, const vcg::Point3f *pN,
+    const int index1, const int index2, const int index3,
+    const double scale1, const double scale2,
+    const int A, const int B, const int C,
+    const double normAng,
+    VoteFn Vote)
+{
+    // 1.0*x + fa*y + fb*z = fc;
+    int a, b, c;
+    double fa, fb, fc;
+    double x = P.V(index1);
+    double y = P.V(index2);
+    double z = P.V(index3);
+
+    if (pN != 0 && normAng > 0.0)
+    {
+        double nx = pN->V(index1);
+        double ny = pN->V(index2) / nx;
+        double nz = pN->V(index3) / nx;
+        // d(slope) = d(ang) * (1 + slope^2), no wider than the window
+        const int kMax = 0.3 / scale1;
+        const double k = D2R(normAng) * (1.0 + ny*ny + nz*nz) / scale1;
+        const int ka = k < kMax ? int(ceil(k)) : kMax;
+        const double ra = ny / scale1 + A / 2 + 0.5;
+        const double rb = nz / scale1 + B / 2 + 0.5;
+        if (!(ra > -ka && ra < A + ka && rb > -ka && rb < B + ka))
+            return;
+        const int a0 = int(floor(ra));
+        const int b0 = int(floor(rb));
+        for (a = std::max(0, a0 - ka); a <= std::min(A - 1, a0 + ka); a++) {
+            fa = (a - A / 2)*scale1;
+            for (b = std::max(0, b0 - ka); b <= std::min(B - 1, b0 + ka); b++) {
+                fb = (b - B / 2)*scale1;
+                fc = -x - fa*y - fb*z;
+                c = fc / scale2 + C / 2;
+                if (c >= 0 && c<C)
+                    Vote(c*A*B + a*A + b);
+            }
+        }
+        return;
+    }
+
+    double a_begin = -1.0;
+    double a_end = 1.0;
+    double b_begin = -1.0;
+    double b_end = 1.0;
+    if (pN != 0)
+    {
+        double nx = pN->V(index1);
+        double ny = pN->V(index2);
+        double nz = pN->V(index3);
+        ny = ny / nx;
+        nz = nz / nx;
+        if (abs(ny) - 1.0>0.3 || abs(nz) - 1.0>0.3)
+            return;
+        a_begin = ny - 0.3;
+        a_end = ny + 0.3;
+        b_begin = nz - 0.3;
+        b_end = nz + 0.3;
+
+        if (a_begin<-1) a_begin = -1;
+        if (a_end>1) a_end = 1;
+        if (b_begin<-1) b_begin = -1;
+        if (b_end>1) b_end = 1;
+    }
+
+    for (fa = a_begin; fa<a_end; fa += scale1) {
+        for (fb = b_begin; fb<b_end; fb += scale1) {
+            fc = -x - fa*y - fb*z;
+            c = fc / scale2 + C / 2;
+            if (c >= 0 && c<C)
+            {
+                a = (fa / scale1 + A / 2);
+                b = (fb / scale1 + B / 2);
+                Vote(c*A*B + a*A + b);
+            }
+        }
+    }
+}
+// Plane of the peak [Temp] = { a, b, c, vote } of the accumulator of [fix], returns the vote
+static int HoughPlaneFromPeak(
+    vcg::Plane3f &Plane,
+    const FixedAxis fix, const int Temp[4],
+    const double scale1, const double scale2,
+    const int A, const int B, const int C,
+    const double seconds)
+{
+    double pa = (Temp[0] - A / 2)*scale1;
+    double pb = (Temp[1] - B / 2)*scale1;
+    double pc = (Temp[2] - C / 2)*scale2;
+    int vote = Temp[3];
+
+    vcg::Point3f N;
+    switch (fix)
+    {
+    case FixedAxis_Z: N = vcg::Point3f( pa,  pb, 1.0); break; //ZXY
+    case FixedAxis_Y: N = vcg::Point3f( pb, 1.0, pa ); break; //YZX
+    case FixedAxis_X: N = vcg::Point3f(1.0,  pa, pb ); break; //XYZ
+    default: return -1;
+    }
+    // N*p = Off
+    Plane.Set(N, -pc);
+
+    flog(
+        "        | [#Time-%7.4f]-[%c-Set]: %d-Pts \n"
+        "        |  >> %7.4fX + %7.4fY + %7.4fZ + %7.4f = 0 |=> %7.4fX + %7.4fY + %7.4fZ = %7.4f \n",
+        seconds, 
+        fix == FixedAxis_X ? 'X' : (fix == FixedAxis_Y ? 'Y' : 'Z'),
+        vote,
+        N.X(), N.Y(), N.Z(), pc,
+        Plane.Direction().X(), Plane.Direction().Y(), Plane.Direction().Z(), Plane.Offset()
+        );
+
+    return vote;
+}
 int HoughPlaneOne(
     vcg::Plane3f &Plane,
     const FixedAxis fix,
     const std::vector<vcg::Point3f> &PointList,
     const std::vector<vcg::Point3f> &NormList,
-    const double _intercept, const double _a, const double _s)
+    const double _intercept, const double _a, const double _s,
+    const double _normAng)
 {
     QTime time;
     time.start();
@@ -19,13 +153,8 @@ int HoughPlaneOne(
         assert(PointList.size() == NormList.size());
 
     int index1, index2, index3;
-    switch (fix)
-    {
-    case FixedAxis_Z: index1 = 2; index2 = 0; index3 = 1; break; //ZXY
-    case FixedAxis_Y: index1 = 1; index2 = 2; index3 = 0; break; //YZX
-    case FixedAxis_X: index1 = 0; index2 = 1; index3 = 2; break; //XYZ
-    default: return -1;
-    }
+    if (!HoughPlaneAxes(fix, index1, index2, index3))
+        return -1;
 
     const double scale1 = _s;
     const double scale2 = _a;
@@ -38,57 +167,13 @@ int HoughPlaneOne(
     for (int i = 0; i<C; i++)
         facPlane[i] = houghBuf + i*A*B;
 
-    // 1.0*x + fa*y + fb*z = fc;
-    int a, b, c;
-    double fa, fb, fc;
-    double x, y, z;
-    auto iterP = PointList.begin();
-    auto iterN = NormList.begin();
-    for (iterP = PointList.begin(); iterP != PointList.end(); iterP++)
-    {
-        x = (*iterP).V(index1);
-        y = (*iterP).V(index2);
-        z = (*iterP).V(index3);
-
-        double a_begin = -1.0;
-        double a_end = 1.0;
-        double b_begin = -1.0;
-        double b_end = 1.0;
-        if (bHasNorm)
-        {
-            double nx = (*iterN).V(index1);
-            double ny = (*iterN).V(index2);
-            double nz = (*iterN).V(index3);
-            iterN++;
-            ny = ny / nx;
-            nz = nz / nx;
-            if (abs(ny) - 1.0>0.3 || abs(nz) - 1.0>0.3)
-                continue;
-            a_begin = ny - 0.3;
-            a_end = ny + 0.3;
-            b_begin = nz - 0.3;
-            b_end = nz + 0.3;
-
-            if (a_begin<-1) a_begin = -1;
-            if (a_end>1) a_end = 1;
-            if (b_begin<-1) b_begin = -1;
-            if (b_end>1) b_end = 1;
-        }
-
-        for (fa = a_begin; fa<a_end; fa += scale1) {
-            for (fb = b_begin; fb<b_end; fb += scale1) {
-                fc = -x - fa*y - fb*z;
-                c = fc / scale2 + C / 2;
-                if (c >= 0 && c<C)
-                {
-                    a = (fa / scale1 + A / 2);
-                    b = (fb / scale1 + B / 2);
-                    (facPlane[c])[a*A + b] += 1;
-                }
-            }
-        }
+    for (int i = 0; i < PointList.size(); i++) {
+        HoughPlaneVotes(PointList[i], bHasNorm ? &NormList[i] : 0,
+            index1, index2, index3, scale1, scale2, A, B, C, _normAng,
+            [&](const int cell) { houghBuf[cell] += 1; });
     }
 
+    int a, b, c;
     int Temp[4] = { 0, 0, 0, 0 };
     int maxVal = (facPlane[0])[0];
 
@@ -112,54 +197,505 @@ int HoughPlaneOne(
     delete[] houghBuf;
     delete[] facPlane;
 
-    
-    double pa = (Temp[0] - A / 2)*scale1;
-    double pb = (Temp[1] - B / 2)*scale1;
-    double pc = (Temp[2] - C / 2)*scale2;
-    int vote = Temp[3];
+    return HoughPlaneFromPeak(Plane, fix, Temp, scale1, scale2, A, B, C, time.elapsed() / 1000.0);
+}
+int HoughPlane(
+    vcg::Plane3f &Plane,
+    const std::vector<vcg::Point3f> &PointList,
+    const std::vector<vcg::Point3f> &NormList,
+    const double _intercept, const double _a, const double _s,
+    const double _normAng)
+{
+    QTime time;
+    time.start();
+    flog(
+        "      [--Plane_HT--]: #nPts-%d \n",
+        PointList.size());
 
-    vcg::Point3f N;
-    switch (fix)
-    {
-    case FixedAxis_Z: N = vcg::Point3f( pa,  pb, 1.0); break; //ZXY
-    case FixedAxis_Y: N = vcg::Point3f( pb, 1.0, pa ); break; //YZX
-    case FixedAxis_X: N = vcg::Point3f(1.0,  pa, pb ); break; //XYZ
-    default: return -1;
+    vcg::Plane3f P[3];
+    int N[3];
+#ifdef _USE_OPENMP_
+#pragma omp parallel for
+#endif // !_USE_OPENMP_
+    for (int i = 0; i < 3; i++) {
+        N[i] = HoughPlaneOne(P[i], FixedAxis(i), PointList, NormList, _intercept, _a, _s, _normAng);
     }
-    // N*p = Off
-    Plane.Set(N, -pc);
+
+    int retIdx = 0;
+    if (N[0]>N[1])
+        retIdx = (N[0]>N[2]) ? 0 : 2;
+    else
+        retIdx = (N[1]>N[2]) ? 1 : 2;
+
+    Plane = P[retIdx];
 
     flog(
-        "        | [#Time-%7.4f]-[%c-Set]: %d-Pts \n"
-        "        |  >> %7.4fX + %7.4fY + %7.4fZ + %7.4f = 0 |=> %7.4fX + %7.4fY + %7.4fZ = %7.4f \n",
-        time.elapsed() / 1000.0, 
-        fix == FixedAxis_X ? 'X' : (fix == FixedAxis_Y ? 'Y' : 'Z'),
-        vote,
-        N.X(), N.Y(), N.Z(), pc,
-        Plane.Direction().X(), Plane.Direction().Y(), Plane.Direction().Z(), Plane.Offset()
+        "        | [+][Checked] : [%d] #nPts-< %d > \n"
+        "      [--Plane_HT--]: Done in %.4f seconds \n",
+        retIdx + 1, N[retIdx], time.elapsed() / 1000.0);
+
+    return N[retIdx];
+}
+
+// Ball layout (the ball accumulator of 3D KHT) : [n] & [-n] are the same orientation, kept
+// on the hemisphere of z >= 0. Row [i] is the ring at the polar angle (i + 0.5)*dTheta, its
+// cells are evenly spaced in azimuth by about dTheta of arc, so all cells are about the same
+// solid angle. The cell [k] of the offset [c] is the plane [orient[k]]*p = rho.
+static const double _HT_PI = 3.14159265358979;
+static int HoughBallRings(
+    const double dAng,
+    std::vector<int> &ringBeg,
+    std::vector<vcg::Point3f> &orient)
+{
+    const int NRing = std::max(1, int(ceil(_HT_PI / 2.0 / dAng)));
+    const double dTheta = _HT_PI / 2.0 / NRing;
+    ringBeg.assign(NRing + 1, 0);
+    orient.clear();
+    for (int i = 0; i < NRing; i++) {
+        const double theta = (i + 0.5)*dTheta;
+        const int NPhi = std::max(1, int(2.0*_HT_PI*sin(theta) / dTheta + 0.5));
+        const double dPhi = 2.0*_HT_PI / NPhi;
+        for (int j = 0; j < NPhi; j++) {
+            const double phi = (j + 0.5)*dPhi;
+            orient.push_back(vcg::Point3f(sin(theta)*cos(phi), sin(theta)*sin(phi), cos(theta)));
+        }
+        ringBeg[i + 1] = orient.size();
+    }
+    return NRing;
+}
+// Cells of the ball within [w] (in radian) of the unit [n], and then of [-n] (as [flip]),
+// [Cell] gets the orientation cell [k], its ring [i] and [flip].
+template<class CellFn>
+static void HoughBallCap(
+    const vcg::Point3f &n, const double w,
+    const int NRing, const int *ringBeg, const vcg::Point3f *orient,
+    CellFn Cell)
+{
+    const double dTheta = _HT_PI / 2.0 / NRing;
+    const double cosW = cos(w);
+    for (int flip = 0; flip < 2; flip++) {
+        const double s = flip ? -1.0 : 1.0;
+        const double nz = std::max(-1.0, std::min(1.0, s*n.Z()));
+        const double thetaN = acos(nz);
+        const double phiN = atan2(s*n.Y(), s*n.X());
+        const int i0 = std::max(0, int(floor((thetaN - w) / dTheta)));
+        const int i1 = std::min(NRing - 1, int(floor((thetaN + w) / dTheta)));
+        const double sinN = sqrt(1.0 - nz*nz);
+        for (int i = i0; i <= i1; i++) {
+            const double cosT = orient[ringBeg[i]].Z();
+            const double sinT = sqrt(1.0 - cosT*cosT);
+            const int NPhi = ringBeg[i + 1] - ringBeg[i];
+            const double dPhi = 2.0*_HT_PI / NPhi;
+            // cos(theta)*cos(thetaN) + sin(theta)*sin(thetaN)*cos(phi - phiN) >= cos(w)
+            const double den = sinT*sinN;
+            const double t = den > 1e-12 ? (cosW - cosT*nz) / den : (cosT*nz >= cosW ? -1.0 : 2.0);
+            if (t > 1.0)
+                continue;
+            int jBeg = 0, jEnd = NPhi - 1;
+            if (t > -1.0) {
+                const double half = acos(t);
+                jBeg = int(ceil((phiN - half) / dPhi - 0.5));
+                jEnd = int(floor((phiN + half) / dPhi - 0.5));
+                if (jEnd - jBeg + 1 >= NPhi) {
+                    jBeg = 0;
+                    jEnd = NPhi - 1;
+                }
+            }
+            int jw = (jBeg % NPhi + NPhi) % NPhi;
+            for (int j = jBeg; j <= jEnd; j++) {
+                Cell(ringBeg[i] + jw, i, flip);
+                if (++jw == NPhi)
+                    jw = 0;
+            }
+        }
+    }
+}
+// Votes of one point on the ball, [Vote] gets the cell [c*NOrient + k] and its row [c*NRing + i].
+// [pN] is 0 without normals (all orientations are voted), otherwise the cap of [w] around the normal.
+template<class VoteFn>
+static void HoughBallVotes(
+    const vcg::Point3f &P, const vcg::Point3f *pN, const double w,
+    const double scale2, const int C,
+    const int NRing, const int *ringBeg, const vcg::Point3f *orient,
+    VoteFn Vote)
+{
+    const int NOrient = ringBeg[NRing];
+    const vcg::Point3f Ps = P / scale2;
+    if (pN == 0) {
+        for (int i = 0; i < NRing; i++) {
+            for (int k = ringBeg[i]; k < ringBeg[i + 1]; k++) {
+                const int c = (orient[k] * Ps) + C / 2;
+                if (c >= 0 && c < C)
+                    Vote(c*NOrient + k, c*NRing + i);
+            }
+        }
+        return;
+    }
+    const double norm = pN->Norm();
+    if (!(norm > 0.0))
+        return;
+    HoughBallCap(*pN / norm, w, NRing, ringBeg, orient, [&](const int k, const int i, const int) {
+        const int c = (orient[k] * Ps) + C / 2;
+        if (c >= 0 && c < C)
+            Vote(c*NOrient + k, c*NRing + i);
+    });
+}
+// Plane of the peak cell of the orientation [N] & the offset [c] on the ball, returns the vote
+static int HoughBallFromPeak(
+    vcg::Plane3f &Plane,
+    const vcg::Point3f &N, const int c, const int vote,
+    const double scale2, const int C,
+    const double seconds)
+{
+    // Center of the offset bin, so that [-N] of the mirrored bin is the same plane
+    const double rho = (c - C / 2 + 0.5)*scale2;
+    Plane.Set(N, rho);
+
+    flog(
+        "        | [#Time-%7.4f]-[B-Set]: %d-Pts \n"
+        "        |  >> %7.4fX + %7.4fY + %7.4fZ = %7.4f \n",
+        seconds, vote,
+        N.X(), N.Y(), N.Z(), rho
         );
 
     return vote;
 }
-int HoughPlane(
-    vcg::Plane3f &Plane,
+
+HoughPlaneAccumulator::HoughPlaneAccumulator(
+    const double _intercept, const double _a, const double _s, const double _normAng,
+    const HoughSpace _space, const double _maxMB)
+    : fineScale1(_s), fineScale2(_a), normAng(_normAng), space(_space), numVoted(0)
+{
+    // Voted at 1/[ratio] of the resolution if the accumulators of [_s] & [_a] exceed [_maxMB]
+    for (ratio = 1; ; ratio++) {
+        setLayout(_intercept, _a*ratio, _s*ratio);
+        const double MB = double(sizeof(unsigned int))*NAxis*NOrient*C / (1024.0*1024.0);
+        if (_maxMB <= 0.0 || MB <= _maxMB || (A <= 3 && C <= 3))
+            break;
+    }
+    if (ratio > 1)
+        flog("      [--Plane_HT--]: Voted at [ 1/%d ] resolution for [ < %.1f MB ] \n", ratio, _maxMB);
+    for (int i = 0; i < 3; i++)
+        m_buf[i] = 0;
+}
+void HoughPlaneAccumulator::setLayout(const double _intercept, const double _a, const double _s)
+{
+    scale1 = _s;
+    scale2 = _a;
+    A = 2 * ceil(1 / scale1) + 1;
+    B = 2 * ceil(1 / scale1) + 1;
+    C = 2 * ceil(_intercept / scale2 + 1) + 1;
+    if (space == HoughSpace_Ball) {
+        // [_s] is the angular step (in radian), as the slope step at the center of an axis
+        NAxis = 1;
+        NRing = HoughBallRings(scale1, m_ringBeg, m_orient);
+        NOrient = m_ringBeg[NRing];
+        // The cap voted around a normal : the +-0.3 window of the axes, or the normal
+        // deviation of [normAng], and at least the cell of the normal
+        ballAng = normAng > 0.0 ? std::min(D2R(normAng), atan(0.3)) : atan(0.3);
+        ballAng = std::max(ballAng, 0.75*_HT_PI / 2.0 / NRing);
+    }
+    else {
+        // Rows of [b] (A == B), the row of cell [c*A*B + a*A + b] is [c*A + a]
+        NAxis = 3;
+        NRing = A;
+        NOrient = A*B;
+        m_ringBeg.resize(A + 1);
+        for (int i = 0; i <= A; i++)
+            m_ringBeg[i] = i*B;
+        ballAng = 0.0;
+    }
+}
+void HoughPlaneAccumulator::vote(
     const std::vector<vcg::Point3f> &PointList,
     const std::vector<vcg::Point3f> &NormList,
-    const double _intercept, const double _a, const double _s)
+    const std::vector<int> *Index, const int sign)
+{
+    const bool bHasNorm = (NormList.size() > 0) ? true : false;
+    if (bHasNorm)
+        assert(PointList.size() == NormList.size());
+    const int NVote = Index != 0 ? Index->size() : PointList.size();
+    const int NRow = C*NRing;
+    // The points are voted by all threads, each cell is added atomically
+    bool bParallel = false;
+#ifdef _USE_OPENMP_
+    bParallel = omp_get_max_threads() > 1 && NVote >= 1024;
+#endif // !_USE_OPENMP_
+    for (int i = 0; i < NAxis; i++) {
+        int index1, index2, index3;
+        HoughPlaneAxes(FixedAxis(i), index1, index2, index3);
+        if (m_buf[i] == 0) {
+            m_buf[i] = new unsigned int[NOrient*C];
+            memset(m_buf[i], 0, sizeof(unsigned int)*NOrient*C);
+            m_rowMax[i].assign(NRow, 0);
+            m_rowArg[i].assign(NRow, 0);
+            m_rowDirty[i].assign(NRow, 1);
+        }
+        unsigned int *houghBuf = m_buf[i];
+        const unsigned int *rowMax = m_rowMax[i].data();
+        char *rowDirty = m_rowDirty[i].data();
+        // A row is scanned again by peak() only if its maximum may have moved.
+        // In parallel a cell is only touched atomically, every row voted by a thread
+        // is marked in its own bitmap and merged after the votes ([dirty] != 0).
+        int NThread = 1;
+#ifdef _USE_OPENMP_
+        if (bParallel)
+            NThread = omp_get_max_threads();
+#endif // !_USE_OPENMP_
+        std::vector<char> threadDirty(bParallel ? (size_t)NThread*NRow : 0, 0);
+        auto add = [&](const int cell, const int row, char *dirty) {
+            if (dirty != 0) {
+#ifdef _USE_OPENMP_
+#pragma omp atomic
+#endif // !_USE_OPENMP_
+                houghBuf[cell]++;
+                dirty[row] = 1;
+            }
+            else if (++houghBuf[cell] >= rowMax[row])
+                rowDirty[row] = 1;
+        };
+        auto sub = [&](const int cell, const int row, char *dirty) {
+            if (dirty != 0) {
+#ifdef _USE_OPENMP_
+#pragma omp atomic
+#endif // !_USE_OPENMP_
+                houghBuf[cell]--;
+                dirty[row] = 1;
+            }
+            else if (houghBuf[cell]-- >= rowMax[row])
+                rowDirty[row] = 1;
+        };
+#ifdef _USE_OPENMP_
+#pragma omp parallel for schedule(dynamic, 256) if(bParallel)
+#endif // !_USE_OPENMP_
+        for (int k = 0; k < NVote; k++) {
+            const int j = Index != 0 ? Index->at(k) : k;
+            const vcg::Point3f *pN = bHasNorm ? &NormList[j] : 0;
+            char *dirty = 0;
+#ifdef _USE_OPENMP_
+            if (bParallel)
+                dirty = &threadDirty[(size_t)omp_get_thread_num()*NRow];
+#endif // !_USE_OPENMP_
+            if (space == HoughSpace_Ball) {
+                if (sign > 0)
+                    HoughBallVotes(PointList[j], pN, ballAng, scale2, C, NRing, m_ringBeg.data(), m_orient.data(),
+                        [&](const int cell, const int row) { add(cell, row, dirty); });
+                else
+                    HoughBallVotes(PointList[j], pN, ballAng, scale2, C, NRing, m_ringBeg.data(), m_orient.data(),
+                        [&](const int cell, const int row) { sub(cell, row, dirty); });
+            }
+            else if (sign > 0)
+                HoughPlaneVotes(PointList[j], pN,
+                    index1, index2, index3, scale1, scale2, A, B, C, normAng,
+                    [&](const int cell) { add(cell, cell / A, dirty); });
+            else
+                HoughPlaneVotes(PointList[j], pN,
+                    index1, index2, index3, scale1, scale2, A, B, C, normAng,
+                    [&](const int cell) { sub(cell, cell / A, dirty); });
+        }
+        for (int t = 0; t < (bParallel ? NThread : 0); t++) {
+            const char *dirty = &threadDirty[(size_t)t*NRow];
+            for (int r = 0; r < NRow; r++)
+                rowDirty[r] |= dirty[r];
+        }
+    }
+    numVoted += sign > 0 ? NVote : -NVote;
+}
+int HoughPlaneAccumulator::updateRows(const int i)
+{
+    const unsigned int *houghBuf = m_buf[i];
+    unsigned int *rowMax = m_rowMax[i].data();
+    int *rowArg = m_rowArg[i].data();
+    char *rowDirty = m_rowDirty[i].data();
+    const int NRow = C*NRing;
+    int nScanned = 0;
+#ifdef _USE_OPENMP_
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:nScanned)
+#endif // !_USE_OPENMP_
+    for (int r = 0; r < NRow; r++) {
+        if (!rowDirty[r])
+            continue;
+        const unsigned int *ptemp = houghBuf + rowBeg(r);
+        const int len = m_ringBeg[r % NRing + 1] - m_ringBeg[r % NRing];
+        // The maximum (vectorized), then its first [b]
+        unsigned int maxVal = ptemp[0];
+        for (int b = 1; b < len; b++)
+            maxVal = ptemp[b] > maxVal ? ptemp[b] : maxVal;
+        int arg = 0;
+        while (ptemp[arg] != maxVal)
+            arg++;
+        rowMax[r] = maxVal;
+        rowArg[r] = arg;
+        rowDirty[r] = 0;
+        nScanned++;
+    }
+    return nScanned;
+}
+int HoughPlaneAccumulator::searchPeaks(const int NPeaks, const int TVote)
+{
+    // Candidates are the row maxima above [TVote] of all axes, by votes & then in scan order
+    const int NCell = NOrient*C;
+    const int NRow = C*NRing;
+    std::vector<std::pair<int, int>> candidates;   // < -vote, axis*NCell + cell >
+    for (int i = 0; i < NAxis; i++) {
+        updateRows(i);
+        const unsigned int *rowMax = m_rowMax[i].data();
+        const int *rowArg = m_rowArg[i].data();
+        for (int r = 0; r < NRow; r++) {
+            if (rowMax[r] > TVote)
+                candidates.push_back(std::make_pair(-int(rowMax[r]), i*NCell + rowBeg(r) + rowArg[r]));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    // Non-maximum suppression, a peak is the largest cell within the window of
+    // [+-ra] in a & b, [+-rc] in c, and NOT in the window of a stronger peak.
+    // On the ball, the window of a & b is the cap of (ra + 0.5) cells around the orientation,
+    // and [-N] is taken with the mirrored offset.
+    const int ra = std::max(1, int(0.05 / scale1 + 0.5));
+    const int rc = 2;
+    const double capAng = space == HoughSpace_Ball ? (ra + 0.5)*_HT_PI / 2.0 / NRing : 0.0;
+    const double cosCap = cos(capAng);
+    std::vector<int> accepted;
+    m_peakQueue.Reset(NPeaks);
+    for (int k = 0; k < candidates.size() && accepted.size() < NPeaks; k++) {
+        const unsigned int vote = -candidates[k].first;
+        const int axis = candidates[k].second / NCell;
+        const int cell = candidates[k].second % NCell;
+        const unsigned int *houghBuf = m_buf[axis];
+        bool bPeak = true;
+        if (space == HoughSpace_Ball) {
+            const int c = cell / NOrient;
+            const vcg::Point3f &N = m_orient[cell % NOrient];
+            for (int q = 0; q < accepted.size() && bPeak; q++) {
+                const int qc = accepted[q] / NOrient;
+                const double d = m_orient[accepted[q] % NOrient] * N;
+                bPeak = !(d >= cosCap && abs(qc - c) <= rc) && !(d <= -cosCap && abs(C - 2 - qc - c) <= rc);
+            }
+            if (bPeak)
+                HoughBallCap(N, capAng, NRing, m_ringBeg.data(), m_orient.data(), [&](const int kk, const int, const int flip) {
+                    const int c0 = flip ? C - 2 - c : c;
+                    for (int cc = std::max(0, c0 - rc); cc <= std::min(C - 1, c0 + rc); cc++)
+                        if (houghBuf[cc*NOrient + kk] > vote)
+                            bPeak = false;
+                });
+        }
+        else {
+            const int c = cell / (A*B), a = (cell / A) % A, b = cell % A;
+            for (int q = 0; q < accepted.size() && bPeak; q++) {
+                const int qCell = accepted[q] % NCell;
+                bPeak = accepted[q] / NCell != axis ||
+                    abs(qCell / (A*B) - c) > rc || abs((qCell / A) % A - a) > ra || abs(qCell % A - b) > ra;
+            }
+            for (int cc = std::max(0, c - rc); cc <= std::min(C - 1, c + rc) && bPeak; cc++)
+                for (int aa = std::max(0, a - ra); aa <= std::min(A - 1, a + ra) && bPeak; aa++)
+                    for (int bb = std::max(0, b - ra); bb <= std::min(B - 1, b + ra) && bPeak; bb++)
+                        bPeak = houghBuf[cc*A*B + aa*A + bb] <= vote;
+        }
+        if (!bPeak)
+            continue;
+        accepted.push_back(candidates[k].second);
+        m_peakQueue.Insert(candidates[k].second, -int(vote));
+    }
+
+    flog(
+        "        | [#Peaks] : %d of %d candidates (> %d votes) are queued \n",
+        accepted.size(), candidates.size(), TVote);
+    return accepted.size();
+}
+int HoughPlaneAccumulator::peakPlane(
+    vcg::Plane3f &Plane, const int axis, const int cell, const int vote,
+    const double seconds) const
+{
+    if (space == HoughSpace_Ball)
+        return HoughBallFromPeak(Plane, m_orient[cell % NOrient], cell / NOrient, vote, scale2, C, seconds);
+    const int Temp[4] = { (cell / A) % A, cell % A, cell / (A*B), vote };
+    return HoughPlaneFromPeak(Plane, FixedAxis(axis), Temp, scale1, scale2, A, B, C, seconds);
+}
+int HoughPlaneAccumulator::peak(vcg::Plane3f &Plane, const int NPeaks, const int TVote)
 {
     QTime time;
     time.start();
     flog(
         "      [--Plane_HT--]: #nPts-%d \n",
-        PointList.size());
+        numVoted);
+
+    Plane = _NON_PLANE;
+    if (!isVoted())
+        return 0;
+
+    // -- Multi-Peak : the strongest queued peak whose votes are still the same
+    if (NPeaks > 1) {
+        const int NCell = NOrient*C;
+        int id = 0, negVote = 0, nRescored = 0;
+        while (1) {
+            if (m_peakQueue.GetNumElements() == 0 && searchPeaks(NPeaks, TVote) == 0)
+                break;
+            m_peakQueue.Remove(id, negVote);
+            const int axis = id / NCell;
+            const int cell = id % NCell;
+            const int vote = m_buf[axis][cell];
+            if (vote != -negVote) {
+                // Some of its points were taken by an accepted plane
+                if (vote > TVote)
+                    m_peakQueue.Insert(id, -vote);
+                nRescored++;
+                continue;
+            }
+            peakPlane(Plane, axis, cell, vote, time.elapsed() / 1000.0);
+            flog(
+                "        | [+][Queued] : [%d] #nPts-< %d >, %d peak(s) re-scored, %d left \n"
+                "      [--Plane_HT--]: Done in %.4f seconds \n",
+                axis + 1, vote, nRescored, m_peakQueue.GetNumElements(), time.elapsed() / 1000.0);
+            return vote;
+        }
+        // No peak above [TVote] is left, the plain search below gives the caller the maximum
+    }
 
     vcg::Plane3f P[3];
-    int N[3];
+    int N[3] = { -1, -1, -1 };
+    const int NRow = C*NRing;
+    // The axes one by one, each searched by all threads
+    for (int i = 0; i < NAxis; i++) {
+        QTime timeOne;
+        timeOne.start();
+        const unsigned int *houghBuf = m_buf[i];
+        const unsigned int *rowMax = m_rowMax[i].data();
+        const int *rowArg = m_rowArg[i].data();
+        int nScanned = updateRows(i);
+
+        // Same order & ties as the full scan of HoughPlaneOne() : the first largest row
+        // (above the cell [0]) of each block of rows, and then of the blocks in order
+        int NBlock = 1;
 #ifdef _USE_OPENMP_
-#pragma omp parallel for
+        NBlock = std::max(1, std::min(omp_get_max_threads(), NRow / 4096));
 #endif // !_USE_OPENMP_
-    for (int i = 0; i < 3; i++) {
-        N[i] = HoughPlaneOne(P[i], FixedAxis(i), PointList, NormList, _intercept, _a, _s);
+        std::vector<int> blockRow(NBlock, -1);
+#ifdef _USE_OPENMP_
+#pragma omp parallel for if(NBlock > 1)
+#endif // !_USE_OPENMP_
+        for (int t = 0; t < NBlock; t++) {
+            unsigned int maxVal = houghBuf[0];
+            for (int r = NRow / NBlock * t; r < (t + 1 < NBlock ? NRow / NBlock * (t + 1) : NRow); r++) {
+                if (rowMax[r] > maxVal) {
+                    blockRow[t] = r;
+                    maxVal = rowMax[r];
+                }
+            }
+        }
+        int cell = 0, vote = 0;
+        unsigned int maxVal = houghBuf[0];
+        for (int t = 0; t < NBlock; t++) {
+            const int r = blockRow[t];
+            if (r >= 0 && rowMax[r] > maxVal)
+            {
+                cell = rowBeg(r) + rowArg[r];
+                vote = rowMax[r];
+                maxVal = rowMax[r];
+            }
+        }
+        N[i] = peakPlane(P[i], i, cell, vote, timeOne.elapsed() / 1000.0);
+        flog("        |  >> %d of %d rows scanned again \n", nScanned, NRow);
     }
 
     int retIdx = 0;
@@ -177,7 +713,104 @@ int HoughPlane(
 
     return N[retIdx];
 }
+int HoughPlaneAccumulator::refine(
+    vcg::Plane3f &Plane,
+    const std::vector<vcg::Point3f> &PointList,
+    const std::vector<vcg::Point3f> &NormList) const
+{
+    QTime time;
+    time.start();
 
+    const bool bHasNorm = (NormList.size() > 0) ? true : false;
+    if (bHasNorm)
+        assert(PointList.size() == NormList.size());
+
+    // Window of the fine sub-accumulator, about one coarse cell around the coarse peak
+    // [N0]*p = [rho0] at each side : normals [N0 + u*e1 + v*e2] & offsets [+-WRho]
+    const vcg::Point3f N0 = Plane.Direction();
+    const double rho0 = Plane.Offset();
+    const int NU = ceil(1.5*ratio);
+    const int NR = ceil(2.0*ratio);
+    const double WAng = NU*fineScale1;
+    const double WRho = NR*fineScale2;
+    vcg::Point3f e1 = (fabs(N0.X()) < 0.9 ? vcg::Point3f(1, 0, 0) : vcg::Point3f(0, 1, 0)) ^ N0;
+    e1.Normalize();
+    const vcg::Point3f e2 = N0 ^ e1;
+
+    // Points consistent with the window : [N]*p of the tilted [N] moves by its tangential part
+    const double cosNorm = cos(std::min(atan(0.3) + WAng, _HT_PI / 2.0));
+    std::vector<int> candidates;
+    vcg::Point3f G(0, 0, 0);
+    for (int i = 0; i < PointList.size(); i++) {
+        const vcg::Point3f &p = PointList[i];
+        const double d = N0*p - rho0;
+        const double t = (p - N0*(N0*p)).Norm();
+        if (fabs(d) > WRho + WAng*t)
+            continue;
+        if (bHasNorm && fabs(NormList[i] * N0) < cosNorm*NormList[i].Norm())
+            continue;
+        candidates.push_back(i);
+        G += p;
+    }
+    if (candidates.empty()) {
+        Plane = _NON_PLANE;
+        return 0;
+    }
+    // The tilted planes turn around the centroid of the candidates on the coarse plane
+    G /= candidates.size();
+    G -= N0*(N0*G - rho0);
+
+    // -- Vote into the [NA*NA*NC] sub-accumulator
+    const int NA = 2 * NU + 1;
+    const int NC = 2 * NR + 1;
+    std::vector<vcg::Point3f> N(NA*NA);
+    std::vector<float> rhoG(NA*NA);
+    for (int iu = 0; iu < NA; iu++) {
+        for (int iv = 0; iv < NA; iv++) {
+            vcg::Point3f n = N0 + e1*((iu - NU)*fineScale1) + e2*((iv - NU)*fineScale1);
+            N[iu*NA + iv] = n.Normalize();
+            rhoG[iu*NA + iv] = n*G;
+        }
+    }
+    std::vector<unsigned int> houghBuf(NA*NA*NC, 0);
+    for (int k = 0; k < candidates.size(); k++) {
+        const vcg::Point3f &p = PointList[candidates[k]];
+        for (int j = 0; j < NA*NA; j++) {
+            const int c = floor((N[j] * p - rhoG[j]) / fineScale2 + 0.5) + NR;
+            if (c >= 0 && c < NC)
+                houghBuf[j*NC + c]++;
+        }
+    }
+    int arg = 0;
+    for (int j = 1; j < houghBuf.size(); j++) {
+        if (houghBuf[j] > houghBuf[arg])
+            arg = j;
+    }
+    const int vote = houghBuf[arg];
+    const double rho = rhoG[arg / NC] + (arg % NC - NR)*fineScale2;
+    Plane.Set(N[arg / NC], rho);
+
+    flog(
+        "        | [#Time-%7.4f]-[Refine]: %d-Pts of %d in [ %d x %d x %d ] \n"
+        "        |  >> %7.4fX + %7.4fY + %7.4fZ = %7.4f \n",
+        time.elapsed() / 1000.0, vote, candidates.size(), NA, NA, NC,
+        Plane.Direction().X(), Plane.Direction().Y(), Plane.Direction().Z(), Plane.Offset());
+
+    return vote;
+}
+void HoughPlaneAccumulator::memRelease()
+{
+    for (int i = 0; i < 3; i++) {
+        if (m_buf[i])
+            delete[] m_buf[i];
+        m_buf[i] = 0;
+        std::vector<unsigned int>().swap(m_rowMax[i]);
+        std::vector<int>().swap(m_rowArg[i]);
+        std::vector<char>().swap(m_rowDirty[i]);
+    }
+    m_peakQueue.Reset(0);
+    numVoted = 0;
+}
 
 // [2] Surface Points Verification
 int AttachToPlane(
@@ -234,6 +867,100 @@ int AttachToPlane(
 
 
 // [3] Coplanar Separation
+int PicRegions(
+    const std::vector<vcg::Point3f> &PointList,
+    const std::vector<int> &Index,
+    const double _TDis,
+    std::vector<std::vector<int>> &Regions)
+{
+    Regions.clear();
+    const int NPts = Index.size();
+    if (NPts == 0)
+        return 0;
+
+    // -- Voxel Grid of [_TDis], the points (by their positions in [Index]) sorted by cells
+    vcg::Box3f box;
+    for (int i = 0; i < NPts; i++)
+        box.Add(PointList.at(Index[i]));
+    const double r = 1.0 / _TDis;
+    const long long NX = (long long)(box.DimX()*r) + 1;
+    const long long NY = (long long)(box.DimY()*r) + 1;
+    const long long NZ = (long long)(box.DimZ()*r) + 1;
+    std::vector<std::pair<long long, int>> cells(NPts);   // < cell, position >
+    for (int i = 0; i < NPts; i++) {
+        const vcg::Point3f p = PointList.at(Index[i]) - box.min;
+        const long long x = std::min(NX - 1, (long long)(p.X()*r));
+        const long long y = std::min(NY - 1, (long long)(p.Y()*r));
+        const long long z = std::min(NZ - 1, (long long)(p.Z()*r));
+        cells[i] = std::make_pair((x*NY + y)*NZ + z, i);
+    }
+    std::sort(cells.begin(), cells.end());
+
+    // -- Union-Find, the points closer than [_TDis] are in the same or the adjacent cells
+    std::vector<int> parent(NPts);
+    for (int i = 0; i < NPts; i++)
+        parent[i] = i;
+    auto find = [&](int i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    };
+    auto link = [&](const int i, const int j) {
+        const int ri = find(i), rj = find(j);
+        if (ri != rj && vcg::Distance(PointList.at(Index[i]), PointList.at(Index[j])) < _TDis)
+            parent[std::max(ri, rj)] = std::min(ri, rj);
+    };
+    for (int b = 0, e = 0; b < NPts; b = e) {
+        const long long key = cells[b].first;
+        while (e < NPts && cells[e].first == key)
+            e++;
+        for (int i = b; i < e; i++)
+            for (int j = i + 1; j < e; j++)
+                link(cells[i].second, cells[j].second);
+        // The 13 cells after this one, each pair of adjacent cells is checked once
+        const long long x = key / (NY*NZ), y = (key / NZ) % NY, z = key % NZ;
+        for (int dx = 0; dx <= 1; dx++) {
+            for (int dy = (dx ? -1 : 0); dy <= 1; dy++) {
+                for (int dz = (dx || dy ? -1 : 1); dz <= 1; dz++) {
+                    if (x + dx >= NX || y + dy < 0 || y + dy >= NY || z + dz < 0 || z + dz >= NZ)
+                        continue;
+                    const long long nKey = ((x + dx)*NY + y + dy)*NZ + z + dz;
+                    std::vector<std::pair<long long, int>>::const_iterator it = std::lower_bound(
+                        cells.begin() + e, cells.end(), std::make_pair(nKey, -1));
+                    for (; it != cells.end() && it->first == nKey; ++it)
+                        for (int i = b; i < e; i++)
+                            link(cells[i].second, it->second);
+                }
+            }
+        }
+    }
+
+    // -- Regions, the largest first. Of the same size, the one of the later point in [Index]
+    //    first, as the region growing from the back of [Index]
+    std::vector<int> regionOf(NPts, -1);
+    std::vector<std::pair<int, int>> order;   // < -size, found order >, of each region
+    for (int i = NPts - 1; i >= 0; i--) {
+        const int root = find(i);
+        if (regionOf[root] < 0) {
+            regionOf[root] = Regions.size();
+            Regions.push_back(std::vector<int>());
+        }
+        Regions[regionOf[root]].push_back(Index[i]);
+    }
+    for (int k = 0; k < Regions.size(); k++) {
+        order.push_back(std::make_pair(-int(Regions[k].size()), k));
+        std::sort(Regions[k].begin(), Regions[k].end());
+    }
+    std::sort(order.begin(), order.end());
+    std::vector<std::vector<int>> sorted(Regions.size());
+    for (int k = 0; k < order.size(); k++)
+        sorted[k].swap(Regions[order[k].second]);
+    Regions.swap(sorted);
+
+    return Regions.size();
+}
 void PicMaxRegion(
     const std::vector<vcg::Point3f> &PointList,
     std::vector<int> &Index,
@@ -245,57 +972,20 @@ void PicMaxRegion(
     if (PointList.empty())
         return;
 
-    std::vector<int> tempLoc;
-    std::vector<int> LocFinal;
-
-    std::vector<vcg::Point3f> seedStack;
-    vcg::Point3f seed;
-    std::vector<int> recorder;
     const int NPtsAll = Index.size();
-    while (!Index.empty())
-    {
-        // Each Cluster
-        seedStack.clear();
-        tempLoc.clear();
-        seedStack.push_back(PointList.at(*(Index.end()-1)));       
-        tempLoc.push_back(*(Index.end() - 1));
-
-        Index.pop_back();
-        // Growing
-        while (!seedStack.empty())
-        {
-            seed = *(seedStack.end()-1);
-            seedStack.pop_back();
-            recorder.clear();
-            for (int i = 0; i<Index.size(); i++)
-            {
-                int p = Index.at(i);
-                if (vcg::Distance(seed, PointList.at(p))<_TDis)
-                {
-                    seedStack.push_back(PointList.at(p));
-                    tempLoc.push_back(p);
-                    recorder.push_back(i);
-                }
-            }
-            for (int i = recorder.size() - 1; i >= 0; i--)
-                Index.erase(Index.begin() + recorder.at(i));
-        }
-        if (tempLoc.size() > LocFinal.size())
-            LocFinal.swap(tempLoc);
-    }
-    Index.swap(LocFinal);
-
-    LocFinal.clear();
-    tempLoc.clear();
-    recorder.clear();
-    std::sort(Index.begin(), Index.end());
+    std::vector<std::vector<int>> regions;
+    if (PicRegions(PointList, Index, _TDis, regions) > 0)
+        Index.swap(regions.front());
+    else
+        Index.clear();
 
     flog(
         "      [--MaxRegion--]: #Pts-%d\n"
         "        | #Threshold_Dis : %.4f\n"
+        "        | #NRegions      : %d\n"
         "        | #NPts_MaxReg   : %d\n"
         "      [--MaxRegion--]: Done in %.4f seconds. \n",
-        NPtsAll, _TDis, Index.size(), time.elapsed() / 1000.0);
+        NPtsAll, _TDis, regions.size(), Index.size(), time.elapsed() / 1000.0);
 }
 
 
@@ -303,7 +993,8 @@ void PicMaxRegion(
 double FinePlane(
     const std::vector<vcg::Point3f> &pointList,
     const std::vector<int> &planeVerList,
-    vcg::Plane3f &plane)
+    vcg::Plane3f &plane,
+    std::string *logBuffer)
 {
     QTime time;
     time.start();
@@ -326,7 +1017,7 @@ double FinePlane(
 
     plane = ple;
 
-    flog(
+    flogTo(logBuffer,
         "      [--Fit_LS--]: #Pts-%d\n"
         "        | #Plane    : %7.4fX + %7.4fY + %7.4fZ = %7.4f \n"
         "        | #FitError : %.4f\n"
@@ -651,7 +1342,12 @@ int DetectHTPlanes(
     const int ExpPlaneNum,
     std::vector<double> *errors,
     std::vector<ObjPatch*> *pPlanes,
-    CMeshO *pMesh, std::vector<int> *pIndexList)
+    CMeshO *pMesh, std::vector<int> *pIndexList,
+    const std::vector<vcg::Plane3f> *pSeedPlanes,
+    const int NPeaksPerPass,
+    const double NormAngHT,
+    const HoughSpace SpaceHT,
+    const double MaxMBHT)
 {
     assert(
         (pPlanes == 0 && pMesh == 0 && pIndexList == 0) ||
@@ -674,6 +1370,10 @@ int DetectHTPlanes(
 
     std::vector<vcg::Plane3f> planeVec;
     int planeNum = 0;
+    int seedNum = 0;
+    const int NSeed = pSeedPlanes != 0 ? pSeedPlanes->size() : 0;
+    // Points are voted once (at the first search), the votes of the removed points are subtracted
+    HoughPlaneAccumulator houghAcc(_intercept, _a, _s, NormAngHT, SpaceHT, MaxMBHT);
     _ResetObjCode(Pt_OnPlane);
     while (1)
     {
@@ -688,19 +1388,33 @@ int DetectHTPlanes(
         if (bHasNorm)
             _planeNT *= 0.5;
 
-        flog("    >> Detecting the [ No.%d ] plane with #Minimum - [ %d ] ...\n", planeNum + 1, _planeNT);
-
         vcg::Plane3f plane;
-        // HT Detection            
-        int NP = HoughPlane(plane, pointList, normList, _intercept, _a, _s); // Center At (0,0,0)
-        if (plane == _NON_PLANE || NP <= _planeNT)
-            break;
-
-        // Surface Points Verification
         std::vector<int> planeVerList;
-        AttachToPlane(planeVerList, pointList, normList, plane, TDis, TAng);
-        if (planeVerList.size() < _planeNT)
-            break;
+        if (seedNum < NSeed) {
+            // Seed Verification (A Failed Seed Is Skipped, NOT the End of Detection)
+            plane = pSeedPlanes->at(seedNum++);
+            flog("    >> Verifying the [ No.%d ] seed plane as the [ No.%d ] plane with #Minimum - [ %d ] ...\n", seedNum, planeNum + 1, _planeNT);
+            AttachToPlane(planeVerList, pointList, normList, plane, TDis, TAng);
+            if (planeVerList.size() < _planeNT)
+                continue;
+        }
+        else {
+            flog("    >> Detecting the [ No.%d ] plane with #Minimum - [ %d ] ...\n", planeNum + 1, _planeNT);
+
+            // HT Detection            
+            if (!houghAcc.isVoted())
+                houghAcc.vote(pointList, normList);
+            int NP = houghAcc.peak(plane, NPeaksPerPass, _planeNT); // Center At (0,0,0)
+            if (houghAcc.isCoarse() && plane != _NON_PLANE)
+                NP = houghAcc.refine(plane, pointList, normList);
+            if (plane == _NON_PLANE || NP <= _planeNT)
+                break;
+
+            // Surface Points Verification
+            AttachToPlane(planeVerList, pointList, normList, plane, TDis, TAng);
+            if (planeVerList.size() < _planeNT)
+                break;
+        }
 
         // Coplanar Separation
         PicMaxRegion(pointList, planeVerList, TDis);
@@ -740,6 +1454,8 @@ int DetectHTPlanes(
         }
 
         // Remove Pts on Plane
+        if (houghAcc.isVoted())
+            houghAcc.vote(pointList, normList, &planeVerList, -1);
         for (int i = planeVerList.size() - 1; i >= 0; --i) {
             int index = planeVerList.at(i);
             pointList.erase(pointList.begin() + index);
@@ -138,7 +138,11 @@ std::vector<ObjCylinder*> PCFit::DetectCylinderGCO(const int expCylinderNum, con
     const double inlierRatio = Threshold_NPtsCylinder;
     const int maxN = expCylinderNum;
     vcg::Box3f Box = mesh.bbox; Box.Translate(-center);   
-    double maxRatio = DetectCylinderRansac(pointList, normList, cylCandidates, TDis, TAng, maxN, inlierRatio, &Box);
+    const RansacScoreMode scoreMode = RansacScore_SPRT;
+    // 2nd sample around the 1st, wide enough for the largest allowed radius
+    const double sampleRadius = std::max(Box.Dim().V(Box.MinDim()) / 8.0, m_refa * 10.0);
+    double maxRatio = DetectCylinderRansac(pointList, normList, cylCandidates, TDis, TAng, maxN, inlierRatio, &Box,
+        scoreMode, true, sampleRadius);
     if (cylCandidates.empty())
         return cylCandidates;
 
@@ -161,37 +165,49 @@ std::vector<ObjCylinder*> PCFit::DetectCylinderGCO(const int expCylinderNum, con
     const int LabelEnergy = TInlier*NoiseEnergy;
     const int lambda = NoiseEnergy;
     const int delta = NoiseEnergy;
+    const CylinderFitMode fitMode = CylinderFit_CoarseToFine;
+    // Labels are infeasible farther than [costBand] (in unit a), 0 for the dense data cost
+    const double costBand = NoiseEnergy * 3.0;
+    MCFGCOWarmStart warmStart(Threshold_CylinderWarmStart);
 
     
     
-    int *gcoResult = new int[pointList.size()];
+    // Neighbor system is cached on PCFit, labeling of the last loop warm starts the next
+    MMFGCOSession session;
     try {
+        session.setNeighbors(GetGCONeighbors(indexList, lambda, delta, numNeighbors));
+#ifdef _USE_OPENMP_
+        // Sites of a tile for the partitioned parallel expansion (multi-threads only)
+        const int gcoTileSites = 50000;
+        if (omp_get_max_threads() > 1)
+            session.setTiles(pointList, gcoTileSites);
+#endif // !_USE_OPENMP_
         for (int _iter = 0; _iter < maxLoop; ++_iter) {
 			flog("    >> [ No.%d ] loop for MCF-GCO ...\n", _iter+1);
-            int numSite = pointList.size();
-            int numLabel = cylCandidates.size() + 1;
-            GCoptimizationGeneralGraph *gco = new GCoptimizationGeneralGraph(numSite, numLabel);
+            // -- Set [Data Energy] [Smooth Energy] [Label Energy] & Solve
             MPFGCOCost gcoCost =
-                MPFGCOGeneratCost(cylCandidates, pointList, normList, m_refa, NoiseEnergy, LabelEnergy);
-            MPFGCONeighbors gcoNei =
-                MPFGCOParseNeighbors(mesh, indexList, lambda, delta, numNeighbors, m_refa);
-            // -- Set [Data Energy]
-            gco->setDataCost(gcoCost.dataCost);
-            // -- Set [Smooth Energy]
-            gco->setSmoothCost(gcoCost.smoothCost);
-            // -- Set [Label Energy]
-            gco->setLabelCost(gcoCost.labelCost);
-            // -- Set Neighbors System
-            gco->setAllNeighbors(gcoNei.neighborsCounts, gcoNei.neighborsIndexes, gcoNei.neighborsWeights);
+                MPFGCOGeneratCost(cylCandidates, pointList, normList, m_refa, NoiseEnergy, LabelEnergy, costBand);
+            session.expansion(gcoCost, maxGCOIteration);
+            gcoCost.memRelease();
 
-            gco->setLabelOrder(true);
-            gco->setVerbosity(1);
-            gco->expansion(maxGCOIteration);
+            // -- Quit the cylinders with too few points (kept aligned with the session)
+            std::vector<int> counts(cylCandidates.size() + 1, 0);
+            for (int i = 0; i < pointList.size(); ++i)
+                counts[session.labels[i]]++;
+            for (int i = cylCandidates.size() - 1; i >= 0; --i) {
+                if (counts[i + 1] <= TInlier) {
+                    flog("    >> Quit cylinder [ Id.%d ] with [ %d < %d ] points ...\n", cylCandidates[i]->m_index, counts[i + 1], TInlier);
+                    delete cylCandidates[i];
+                    cylCandidates.erase(cylCandidates.begin() + i);
+                    warmStart.erase(i);
+                    session.dropModel(i);
+                }
+            }
+            if (cylCandidates.empty())
+                break;
 
             // -- Get Result <& Re-Estimate>
-            for (int i = 0; i < numSite; i++)
-                gcoResult[i] = gco->whatLabel(i);
-            GCOReEstimat(cylCandidates, pointList, gcoResult, TInlier);
+            GCOReEstimat(cylCandidates, pointList, session.labels.data(), TInlier, fitMode, &normList, &warmStart);
 
             // -- Check Inlier Ratio
             std::vector<int> inliers;
@@ -201,6 +217,8 @@ std::vector<ObjCylinder*> PCFit::DetectCylinderGCO(const int expCylinderNum, con
                     flog("    >> Quit cylinder [ Id.%d ] with [ %d > %d ] points ...\n", cylCandidates[i]->m_index, _inliers, TInlier);
                     delete cylCandidates[i];
                     cylCandidates.erase(cylCandidates.begin() + i);
+                    warmStart.erase(i);
+                    session.dropModel(i);
                     i--;
                 }
                 else
@@ -215,21 +233,21 @@ std::vector<ObjCylinder*> PCFit::DetectCylinderGCO(const int expCylinderNum, con
                         if (inliers.at(i) < inliers.at(j)) {
                             std::swap(cylCandidates.at(i), cylCandidates.at(j));
                             std::swap(inliers.at(i), inliers.at(j));
+                            warmStart.swap(i, j);
+                            session.swapModels(i, j);
                         }
                         flog("    >> Remove cylinder [ Id.%d |%d ] as it is similar to[ Id.%d | %d ]  ...\n",
                             cylCandidates[i]->m_index, inliers[i],
                             cylCandidates[j]->m_index, inliers[j]);
                         cylCandidates.erase(cylCandidates.begin() + j);
                         inliers.erase(inliers.begin() + j);
+                        warmStart.erase(j);
+                        session.mergeModel(j, i);
                         j--;                       
                     }
                 }
             }
 
-            // -- Cleaning Up GCO Memory
-            gcoCost.memRelease();
-            gcoNei.memRelease();
-
             // -- Continue OR Break
             if (cylCandidates.empty())
                 break;
@@ -242,7 +260,7 @@ std::vector<ObjCylinder*> PCFit::DetectCylinderGCO(const int expCylinderNum, con
 	indexList.clear();
 	pointList.clear();
 	normList.clear();
-	delete[] gcoResult;
+	session.memRelease();
 
 
 	// -- Move Back
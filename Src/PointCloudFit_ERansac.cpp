@@ -0,0 +1,82 @@
+#include "PointCloudFit.h"
+#include "PointCloudFitUtil.h"
+
+int PCFit::DetectPrimitivesERansac(
+    std::vector<ObjPatch*> &patches,
+    std::vector<ObjCylinder*> &cylinders,
+    const int expShapeNum)
+{
+    CMeshO &mesh = m_meshDoc.mesh->cm;
+
+    // -- Get Normalized Point List (Moved So That the Center is [0,0])
+    std::vector<int> indexList;
+    std::vector<vcg::Point3f> pointList;
+    std::vector<vcg::Point3f> normList;
+    vcg::Point3f center = GetPointList(indexList, pointList, normList, true);
+    const bool bHasNorm = !normList.empty();
+    if (!bHasNorm)
+        flog("    >> [ ): ] Normals are needed to detected cylinder, ONLY planes will be detected. \n");
+
+    // -- Calculate Thresholds (Same As DetectPlanesHT & DetectCylinderGCO)
+    const double TDis = m_refa*Threshold_DisToSurface;
+    const double TAng = Threshold_AngToSurface;
+    const int _THard = fmax(300, pointList.size()*0.01);
+    int TNPtsPlane = fmax(pointList.size()*Threshold_NPtsPlane, _THard);
+    if (bHasNorm)
+        TNPtsPlane *= 0.5;
+    const int TNPtsCylinder = bHasNorm ? pointList.size()*Threshold_NPtsCylinder : 0;
+    vcg::Box3f Box = mesh.bbox; Box.Translate(-center);
+
+    // -- Detect Shapes
+    std::vector<ERansacShape> shapes;
+    DetectERansacShapes(
+        shapes, pointList, normList,
+        TDis, TAng, TNPtsPlane, TNPtsCylinder,
+        expShapeNum, &Box);
+
+    // -- Extract Objects
+    _ResetObjCode(Pt_OnPlane);
+    _ResetObjCode(Pt_OnCylinder);
+    for (int i = 0; i < shapes.size(); ++i) {
+        const ERansacShape &shape = shapes.at(i);
+        if (shape.type == Pt_OnPlane) {
+            // Extract the Minimum-Bounding-Rectangle
+            ObjRect *oneRect = ExtractMBR(mesh, shape.plane, pointList, indexList, shape.verList);
+            if (oneRect == 0)
+                continue;
+            oneRect->m_varN = shape.err;
+            // Circle Check
+            ObjCircle *oneCircle = CircleCheck(oneRect, pointList, shape.verList);
+            if (oneCircle != 0) {
+                delete oneRect;
+                patches.push_back(oneCircle);
+            }
+            else
+                patches.push_back(oneRect);
+        }
+        else {
+            ObjCylinder *cyl = new ObjCylinder(_GetObjCode(Pt_OnCylinder));
+            cyl->m_O = shape.O;
+            cyl->m_N = shape.N;
+            cyl->m_radius = shape.radius;
+            cyl->m_length = 1.0;
+            cylinders.push_back(cyl);
+        }
+    }
+    indexList.clear();
+    pointList.clear();
+    normList.clear();
+    shapes.clear();
+
+    // -- Move Back
+    for (int i = 0; i < patches.size(); ++i)
+        patches.at(i)->m_O += center;
+    for (int i = 0; i < cylinders.size(); ++i)
+        cylinders.at(i)->m_O += center;
+
+    // -- Attach (Label Points & Fit Length)
+    if (!cylinders.empty())
+        AttachToCylinder(mesh, cylinders, TDis, TAng);
+
+    return patches.size() + cylinders.size();
+}
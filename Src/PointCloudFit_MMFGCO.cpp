@@ -0,0 +1,259 @@
+#include "PointCloudFit.h"
+#include "PointCloudFitUtil.h"
+#include "gco/GCoptimization.h"
+
+int PCFit::DetectPrimitivesGCO(
+    std::vector<ObjPatch*> &patches,
+    std::vector<ObjCylinder*> &cylinders,
+    const int expModelNum, const int iteration)
+{
+    CMeshO &mesh = m_meshDoc.mesh->cm;
+
+    // -- Get Normalized Point List (Moved So That the Center is [0,0])
+    std::vector<int> indexList;
+    std::vector<vcg::Point3f> pointList;
+    std::vector<vcg::Point3f> normList;
+    vcg::Point3f center = GetPointList(indexList, pointList, normList, true);
+    const bool bHasNorm = !normList.empty();
+    if (!bHasNorm)
+        flog("    >> [ ): ] Normals are needed to detected cylinder, ONLY planes will be detected. \n");
+    if (pointList.empty())
+        return 0;
+
+    // -- Calculate Thresholds (Same As DetectPlanesHT & DetectCylinderGCO)
+    double candidate1 = mesh.bbox.Diag() * sqrt(3.0) / 2.0;
+    double candidate2 = mesh.bbox.DimX() + mesh.bbox.DimY() + mesh.bbox.DimZ();
+    double intercept = (candidate1 < candidate2) ? candidate1 : candidate2;
+    const double TDis = m_refa*Threshold_DisToSurface;
+    const double TAng = Threshold_AngToSurface;
+    const int _THard = fmax(300, pointList.size()*0.01);
+    const double inlierRatio = Threshold_NPtsCylinder;
+    vcg::Box3f Box = mesh.bbox; Box.Translate(-center);
+
+    // -- Plane Candidates (One Pass of Hough Transform)
+    std::vector<vcg::Plane3f> planeCandidates;
+    DetectHTPlanes(
+        planeCandidates, pointList, normList,
+        intercept, m_refa, Precision_HT,
+        TDis, TAng,
+        Threshold_NPtsPlane, _THard, expModelNum,
+        0, 0, 0, 0, 0, Precision_HTPeaks, Precision_HTNormAng, HoughSpace(Precision_HTSpace), Precision_HTMaxMB);
+
+    // -- Cylinder Candidates (RANSAC on the points off the plane candidates)
+    std::vector<ObjCylinder*> cylCandidates;
+    int TInlier = 0;
+    if (bHasNorm) {
+        std::vector<char> onPlane(pointList.size(), 0);
+        for (int i = 0; i < planeCandidates.size(); ++i) {
+            std::vector<int> planeVerList;
+            AttachToPlane(planeVerList, pointList, normList, planeCandidates.at(i), TDis, TAng);
+            for (int k = 0; k < planeVerList.size(); ++k)
+                onPlane[planeVerList.at(k)] = 1;
+        }
+        std::vector<vcg::Point3f> restPoints;
+        std::vector<vcg::Point3f> restNorms;
+        for (int i = 0; i < pointList.size(); ++i) {
+            if (!onPlane[i]) {
+                restPoints.push_back(pointList.at(i));
+                restNorms.push_back(normList.at(i));
+            }
+        }
+        TInlier = inlierRatio*restPoints.size();
+        if (restPoints.size() >= mesh.vn*Threshold_NPtsCylinder) {
+            // 2nd sample around the 1st, wide enough for the largest allowed radius
+            const double sampleRadius = std::max(Box.Dim().V(Box.MinDim()) / 8.0, m_refa * 10.0);
+            DetectCylinderRansac(restPoints, restNorms, cylCandidates, TDis, TAng, expModelNum, inlierRatio, &Box,
+                RansacScore_SPRT, true, sampleRadius);
+        }
+    }
+    flog("    >> [ %d ] plane and [ %d ] cylinder candidates ...\n", planeCandidates.size(), cylCandidates.size());
+
+    // -- Fit by GCO (Planes & Cylinders Are the Labels of One Energy)
+    // E(f)       = Sigma_p{Dp(lp)} + lambda*Sigma_(pg:N){Vpg(lq,pq)} + labelEnergy*|L| .
+    // Dp(lp)     = cost of the plane OR cylinder lp (see MPFGCOGeneratCost()), if lp != 0;
+    //            = noiseEnergy                                              , otherwise.
+    // Vpq(lp,lq) = w_{p,q}*d_{lp,lq}.
+    // d_{lp,lq}  = 1 , if lp != lq;
+    //            = 0 , otherwise (i.e. lp = lq).
+    // w_{p,q}    = lambda * exp{ - (||p-q||_2) ^ 2 / 2*delta^2} .
+    // numNeighbors := KNN numbers of neighbor system N, i.e. |N| .
+    // Labels [1, NPlane] are the planes, the cylinders follow.
+    const int maxLoop = 3;
+    const int maxGCOIteration = iteration > 0 ? iteration : 10;
+    const int numNeighbors = 5;
+    const int NoiseEnergy = Threshold_DisToSurface * 2;
+    const int LabelEnergy = _THard*NoiseEnergy;
+    const int lambda = NoiseEnergy;
+    const int delta = NoiseEnergy;
+    const CylinderFitMode fitMode = CylinderFit_CoarseToFine;
+    // Labels are infeasible farther than [costBand] (in unit a), 0 for the dense data cost
+    const double costBand = NoiseEnergy * 3.0;
+    MCFGCOWarmStart warmStart(Threshold_CylinderWarmStart);
+
+    const int NPlane = planeCandidates.size();
+    std::vector<int> planeLabels;
+    std::vector<int> cylLabels;
+    MMFGCOSession session;
+    try {
+        session.setNeighbors(GetGCONeighbors(indexList, lambda, delta, numNeighbors));
+#ifdef _USE_OPENMP_
+        // Sites of a tile for the partitioned parallel expansion (multi-threads only)
+        const int gcoTileSites = 50000;
+        if (omp_get_max_threads() > 1)
+            session.setTiles(pointList, gcoTileSites);
+#endif // !_USE_OPENMP_
+        for (int _iter = 0; _iter < maxLoop; ++_iter) {
+            flog("    >> [ No.%d ] loop for MMF-GCO ...\n", _iter + 1);
+            // -- Set [Data Energy] [Smooth Energy] [Label Energy] & Solve
+            MPFGCOCost gcoCost = MPFGCOGeneratCost(
+                planeCandidates, cylCandidates, pointList, normList, m_refa, NoiseEnergy, LabelEnergy, costBand);
+            session.expansion(gcoCost, maxGCOIteration);
+            gcoCost.memRelease();
+            if (cylCandidates.empty())
+                break;
+
+            // -- Quit the cylinders with too few points (kept aligned with the session)
+            std::vector<int> counts(cylCandidates.size() + 1, 0);
+            for (int i = 0; i < pointList.size(); ++i)
+                counts[session.labels[i] > NPlane ? session.labels[i] - NPlane : 0]++;
+            for (int i = cylCandidates.size() - 1; i >= 0; --i) {
+                if (counts[i + 1] <= TInlier) {
+                    flog("    >> Quit cylinder [ Id.%d ] with [ %d < %d ] points ...\n", cylCandidates[i]->m_index, counts[i + 1], TInlier);
+                    delete cylCandidates[i];
+                    cylCandidates.erase(cylCandidates.begin() + i);
+                    warmStart.erase(i);
+                    session.dropModel(NPlane + i);
+                }
+            }
+
+            // -- Re-Estimate the cylinders by their own labels
+            cylLabels.resize(pointList.size());
+            for (int i = 0; i < pointList.size(); ++i)
+                cylLabels[i] = session.labels[i] > NPlane ? session.labels[i] - NPlane : 0;
+            GCOReEstimat(cylCandidates, pointList, cylLabels.data(), TInlier, fitMode, &normList, &warmStart);
+
+            // -- Check Inlier Ratio
+            std::vector<int> inliers;
+            for (int i = 0; i < cylCandidates.size(); ++i) {
+                int _inliers = CylinderInliers(*cylCandidates.at(i), pointList, normList, TDis, TAng);
+                if (_inliers < TInlier) {
+                    flog("    >> Quit cylinder [ Id.%d ] with [ %d > %d ] points ...\n", cylCandidates[i]->m_index, _inliers, TInlier);
+                    delete cylCandidates[i];
+                    cylCandidates.erase(cylCandidates.begin() + i);
+                    warmStart.erase(i);
+                    session.dropModel(NPlane + i);
+                    i--;
+                }
+                else
+                    inliers.push_back(_inliers);
+            }
+
+            // -- Merge The Closer
+            for (int i = 0; i + 1 < cylCandidates.size(); ++i) {
+                for (int j = i + 1; j < cylCandidates.size(); ++j) {
+                    if (CloseCylinders(*cylCandidates.at(i), *cylCandidates.at(j))) {
+                        if (inliers.at(i) < inliers.at(j)) {
+                            std::swap(cylCandidates.at(i), cylCandidates.at(j));
+                            std::swap(inliers.at(i), inliers.at(j));
+                            warmStart.swap(i, j);
+                            session.swapModels(NPlane + i, NPlane + j);
+                        }
+                        flog("    >> Remove cylinder [ Id.%d |%d ] as it is similar to[ Id.%d | %d ]  ...\n",
+                            cylCandidates[i]->m_index, inliers[i],
+                            cylCandidates[j]->m_index, inliers[j]);
+                        cylCandidates.erase(cylCandidates.begin() + j);
+                        inliers.erase(inliers.begin() + j);
+                        warmStart.erase(j);
+                        session.mergeModel(NPlane + j, NPlane + i);
+                        j--;
+                    }
+                }
+            }
+        }
+
+        // -- Split the final labeling by model type
+        if (session.labels.size() == pointList.size()) {
+            planeLabels.resize(pointList.size());
+            cylLabels.assign(pointList.size(), 0);
+            for (int i = 0; i < pointList.size(); ++i) {
+                const int label = session.labels[i];
+                planeLabels[i] = label <= NPlane ? label : 0;
+                if (label > NPlane && label - NPlane <= cylCandidates.size())
+                    cylLabels[i] = label - NPlane;
+            }
+        }
+    }
+    catch (GCException e) {
+        e.Report();
+        planeLabels.clear();
+        cylLabels.clear();
+    }
+    session.memRelease();
+
+    // -- Extract Planes (As DetectHTPlanes : Coplanar Separation, Size & Circle Check)
+    //    a label may hold disjoint coplanar faces, ONLY its max region is kept
+    if (planeLabels.size() == pointList.size()) {
+        int TNPtsPlane = fmax(pointList.size()*Threshold_NPtsPlane, _THard);
+        if (bHasNorm)
+            TNPtsPlane *= 0.5;
+        std::vector<std::vector<int>> planeVerList(NPlane + 1);
+        for (int i = 0; i < pointList.size(); ++i)
+            planeVerList[planeLabels[i]].push_back(i);
+        for (int k = 1; k < NPlane + 1; ++k) {
+            std::vector<int> &verList = planeVerList[k];
+            if (verList.size() < TNPtsPlane) {
+                flog("    >> Quit plane [ No.%d ] with [ %d < %d ] labeled points ...\n", k, verList.size(), TNPtsPlane);
+                continue;
+            }
+            PicMaxRegion(pointList, verList, TDis);
+            if (verList.size() < _THard) {
+                flog("    >> Quit plane [ No.%d ] with [ %d < %d ] points in its max region ...\n", k, verList.size(), _THard);
+                continue;
+            }
+            // Least Square Fit & the Minimum-Bounding-Rectangle
+            vcg::Plane3f plane;
+            double err = FinePlane(pointList, verList, plane);
+            ObjRect *oneRect = ExtractMBR(mesh, plane, pointList, indexList, verList);
+            if (oneRect == 0)
+                continue;
+            oneRect->m_varN = err;
+            // Circle Check
+            ObjCircle *oneCircle = CircleCheck(oneRect, pointList, verList);
+            if (oneCircle != 0) {
+                delete oneRect;
+                patches.push_back(oneCircle);
+            }
+            else
+                patches.push_back(oneRect);
+        }
+    }
+    for (int i = 0; i < patches.size(); ++i)
+        patches.at(i)->m_O += center;
+
+    // -- Extract Cylinders (Points Are Labeled by GCO, NOT Attached Again)
+    CMeshO::PerVertexAttributeHandle<PtType> type_hi =
+        vcg::tri::Allocator<CMeshO>::FindPerVertexAttribute<PtType>(mesh, PtAttri_GeoType);
+    std::vector<std::vector<int>> cylVerList(cylCandidates.size() + 1);
+    for (int i = 0; i < cylLabels.size(); ++i)
+        cylVerList[cylLabels[i]].push_back(indexList.at(i));
+    for (int k = 0; k < cylCandidates.size(); ++k) {
+        ObjCylinder *cyl = cylCandidates.at(k);
+        std::vector<int> &inlierIdx = cylVerList[k + 1];
+        if (inlierIdx.size() < TInlier || inlierIdx.empty()) {
+            flog("    >> Quit cylinder [ Id.%d ] with [ %d < %d ] labeled points ...\n", cyl->m_index, inlierIdx.size(), TInlier);
+            delete cyl;
+            continue;
+        }
+        cyl->m_O += center;
+        FineCylinderLength(mesh, *cyl, inlierIdx);
+        for (int i = 0; i < inlierIdx.size(); ++i)
+            type_hi[inlierIdx[i]] = Pt_OnCylinder;
+        cylinders.push_back(cyl);
+    }
+
+    indexList.clear();
+    pointList.clear();
+    normList.clear();
+
+    return patches.size() + cylinders.size();
+}
@@ -2,7 +2,7 @@
 #include "PointCloudFitUtil.h"
 #include "gco/GCoptimization.h"
 
-std::vector<ObjPatch*> PCFit::DetectPlanesHT(const int expPlaneNum)
+std::vector<ObjPatch*> PCFit::DetectPlanesHT(const int expPlaneNum, const std::vector<ObjPatch*> *seedPatches)
 {
     CMeshO &mesh = m_meshDoc.mesh->cm;
 
@@ -22,6 +22,17 @@ std::vector<ObjPatch*> PCFit::DetectPlanesHT(const int expPlaneNum)
 	const double _planeAngThreshold = Threshold_AngToSurface;
 	const int _THard = fmax(300, pointList.size()*0.01);
 
+    // -- Seed Planes (Moved So That the Center is [0,0])
+    std::vector<vcg::Plane3f> seedPlanes;
+    if (seedPatches != 0) {
+        for (int i = 0; i < seedPatches->size(); ++i) {
+            const ObjPatch *patch = seedPatches->at(i);
+            vcg::Plane3f plane;
+            plane.Init(patch->m_O - center, patch->m_N);
+            seedPlanes.push_back(plane);
+        }
+    }
+
     // -- Detect Planes
     std::vector<ObjPatch*> patches;
     std::vector<vcg::Plane3f> planes; // Useless
@@ -32,7 +43,8 @@ std::vector<ObjPatch*> PCFit::DetectPlanesHT(const int expPlaneNum)
         _planeDisThreshold, _planeAngThreshold,
         Threshold_NPtsPlane, _THard, expPlaneNum,
         0,
-        &patches, &mesh, &indexList);
+        &patches, &mesh, &indexList,
+        seedPatches != 0 ? &seedPlanes : 0, Precision_HTPeaks, Precision_HTNormAng, HoughSpace(Precision_HTSpace), Precision_HTMaxMB);
 
     // -- Move Back
     for (int i = 0; i<patches.size(); ++i) {
@@ -93,42 +105,34 @@ std::vector<ObjPatch*> PCFit::DetectPlanesGCO(const int expPlaneNum, const int i
     int delta = 10;
 
     int numNeighbors = 7;
+    // Labels are infeasible farther than [costBand] (in unit a), 0 for the dense data cost
+    const double costBand = NoiseEnergy * 3.0;
     int maxIteration = iteration > 0 ? iteration : 100;
-    int *gcoResult = new int[pointList.size()];
+    MMFGCOSession session;
 	try{
-        int numSite = pointList.size();
-        int numLabel = planeCandidates.size() + 1;
-		GCoptimizationGeneralGraph *gco = new GCoptimizationGeneralGraph(numSite, numLabel);
         MPFGCOCost gcoCost = 
-            MPFGCOGeneratCost(planeCandidates, pointList, normList, m_refa, NoiseEnergy, LabelEnergy);
-        MPFGCONeighbors gcoNei = 
-            MPFGCOParseNeighbors(mesh, indexList, lambda, delta, numNeighbors, m_refa);
-        // -- Set [Data Energy]
-        gco->setDataCost(gcoCost.dataCost);
-        // -- Set [Smooth Energy]
-        gco->setSmoothCost(gcoCost.smoothCost);
-        // -- Set [Label Energy]
-        gco->setLabelCost(gcoCost.labelCost);
-        // -- Set Neighbors System
-        gco->setAllNeighbors(gcoNei.neighborsCounts, gcoNei.neighborsIndexes, gcoNei.neighborsWeights);
-
-        gco->setLabelOrder(true);
-        gco->setVerbosity(1);
-        gco->expansion(maxIteration);
+            MPFGCOGeneratCost(planeCandidates, pointList, normList, m_refa, NoiseEnergy, LabelEnergy, costBand);
+        session.setNeighbors(GetGCONeighbors(indexList, lambda, delta, numNeighbors));
+#ifdef _USE_OPENMP_
+        // Sites of a tile for the partitioned parallel expansion (multi-threads only)
+        const int gcoTileSites = 50000;
+        if (omp_get_max_threads() > 1)
+            session.setTiles(pointList, gcoTileSites);
+#endif // !_USE_OPENMP_
+        // -- Set [Data Energy] [Smooth Energy] [Label Energy] & Solve
+        session.expansion(gcoCost, maxIteration);
         
         // -- Get Result <& Re-Estimate>
-        for (int i = 0; i < numSite; i++)
-            gcoResult[i] = gco->whatLabel(i);
-        // errors = GCOReEstimat(planeCandidates, pointList, gcoResult, 100);
+        // errors = GCOReEstimat(planeCandidates, pointList, session.labels.data(), 100);
 
         // -- Cleaning Up
         gcoCost.memRelease();
-        gcoNei.memRelease();
 	}
 	catch (GCException e){
 		e.Report();
 	}
-    ExtractPatches(mesh, patches, indexList, pointList, planeCandidates.size(), gcoResult);
+    if (session.labels.size() == pointList.size())
+        ExtractPatches(mesh, patches, indexList, pointList, planeCandidates.size(), session.labels.data());
 
 
     // -- Move Back
@@ -140,7 +144,7 @@ std::vector<ObjPatch*> PCFit::DetectPlanesGCO(const int expPlaneNum, const int i
     indexList.clear();
     pointList.clear();
     normList.clear();
-    delete[] gcoResult;
+    session.memRelease();
 
     return patches;
 }
@@ -1,4 +1,5 @@
 #include "PointCloudFit.h"
+#include "PointCloudFitUtil.h"
 #include "PCA/PCA.h"
 
 #include <wrap/io_trimesh/io_mask.h>
@@ -158,6 +159,22 @@ vcg::Point3f PCFit::GetPointList(
     return center;
 }
 
+const MPFGCONeighbors &PCFit::GetGCONeighbors(
+    const std::vector<int> &indexList,
+    const int lambda, const double delta,
+    const int numNeighbors)
+{
+    if (m_gcoNeighbors == 0)
+        m_gcoNeighbors = new MPFGCONeighbors();
+    if (m_gcoNeighbors->isBuiltFor(indexList, lambda, delta, numNeighbors, m_refa)) {
+        flog("    >> Reuse the neighbor system of #%d Pts.\n", indexList.size());
+        return *m_gcoNeighbors;
+    }
+    m_gcoNeighbors->memRelease();
+    *m_gcoNeighbors = MPFGCOParseNeighbors(m_meshDoc.mesh->cm, indexList, lambda, delta, numNeighbors, m_refa);
+    return *m_gcoNeighbors;
+}
+
 
 int PCFit::DeNoiseKNN()
 {
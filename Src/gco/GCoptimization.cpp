@@ -115,6 +115,8 @@ GCoptimization::GCoptimization(SiteID nSites, LabelID nLabels)
 , m_labeling(new LabelID[nSites])
 , m_labelTable(new LabelID[nLabels])
 , m_labelingDataCosts(new EnergyTermType[nSites])
+, m_energyArena(0)
+, m_activeSites(new SiteID[nSites])
 , m_labelCounts(new SiteID[nLabels])
 , m_activeLabelCounts(new SiteID[m_num_labels])
 , m_stepsThisCycle(0)
@@ -129,6 +131,7 @@ GCoptimization::GCoptimization(SiteID nSites, LabelID nLabels)
 		if (m_labeling) delete [] m_labeling;
 		if (m_labelingDataCosts) delete [] m_labelingDataCosts;
 		if (m_labelCounts) delete [] m_labelCounts;
+		if (m_activeSites) delete [] m_activeSites;
 		handleError("Not enough memory.");
 	}
 	
@@ -148,6 +151,8 @@ GCoptimization::~GCoptimization()
 	delete [] m_labelingDataCosts;
 	delete [] m_labelCounts;
 	delete [] m_activeLabelCounts;
+	delete [] m_activeSites;
+	if (m_energyArena) delete m_energyArena;
 
 	if (m_datacostFnDelete) m_datacostFnDelete(m_datacostFn);
 	if (m_smoothcostFnDelete) m_smoothcostFnDelete(m_smoothcostFn);
@@ -407,6 +412,96 @@ void GCoptimization::setupSmoothCostsSwap(SiteID size, LabelID alpha_label,Label
 	}
 }
 
+//-----------------------------------------------------------------------------------
+// Potts model: every term is w*[l1 != l2], which is a metric, so the terms are
+// built from label comparisons only and just the weight needs the overflow check.
+
+template <>
+void GCoptimization::setupSmoothCostsExpansion<GCoptimization::SmoothCostFnPotts>(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites)
+{
+	SiteID i,nSite,site,n,nNum,*nPointer;
+	EnergyTermType *weights;
+
+	for ( i = size - 1; i >= 0; i-- )
+	{
+		site = activeSites[i];
+		const LabelID l = m_labeling[site];
+		const EnergyTermType d = (EnergyTermType)(l != alpha_label);
+		giveNeighborInfo(site,&nNum,&nPointer,&weights);
+		for ( n = 0; n < nNum; n++ )
+		{
+			nSite = nPointer[n];
+			const EnergyTermType w = weights[n];
+			if ( w > GCO_MAX_ENERGYTERM )
+				handleError("Smoothness weight was larger than GCO_MAX_ENERGYTERM; danger of integer overflow.");
+			const LabelID ln = m_labeling[nSite];
+			const EnergyTermType e01 = w*(EnergyTermType)(alpha_label != ln);
+			const EnergyTermType e11 = w*(EnergyTermType)(l != ln);
+			if ( m_lookupSiteVar[nSite] == -1 )
+			{
+				m_beforeExpansionEnergy += e11;
+				e->add_term1(i,e01,e11);
+			}
+			else if ( nSite < site )
+			{
+				m_beforeExpansionEnergy += e11;
+				e->add_term2(i,m_lookupSiteVar[nSite],0,e01,w*d,e11);
+			}
+		}
+	}
+}
+
+template <>
+void GCoptimization::setupSmoothCostsSwap<GCoptimization::SmoothCostFnPotts>(SiteID size, LabelID alpha_label,LabelID beta_label,
+										 EnergyT *e,SiteID *activeSites )
+{
+	SiteID i,nSite,site,n,nNum,*nPointer;
+	EnergyTermType *weights;
+	const EnergyTermType d = (EnergyTermType)(alpha_label != beta_label);
+
+	for ( i = size - 1; i >= 0; i-- )
+	{
+		site = activeSites[i];
+		giveNeighborInfo(site,&nNum,&nPointer,&weights);
+		for ( n = 0; n < nNum; n++ )
+		{
+			nSite = nPointer[n];
+			const EnergyTermType w = weights[n];
+			if ( w > GCO_MAX_ENERGYTERM )
+				handleError("Smoothness weight was larger than GCO_MAX_ENERGYTERM; danger of integer overflow.");
+			if ( m_lookupSiteVar[nSite] == -1 )
+			{
+				const LabelID ln = m_labeling[nSite];
+				const EnergyTermType e1 = w*(EnergyTermType)(beta_label != ln);
+				m_beforeExpansionEnergy += e1;
+				e->add_term1(i,w*(EnergyTermType)(alpha_label != ln),e1);
+			}
+			else if ( nSite < site )
+				e->add_term2(i,m_lookupSiteVar[nSite],0,w*d,w*d,0);
+		}
+	}
+}
+
+template <>
+GCoptimization::EnergyType GCoptimization::giveSmoothEnergyInternal<GCoptimization::SmoothCostFnPotts>()
+{
+	EnergyType eng = (EnergyType) 0;
+	SiteID i,numN,*nPointer,n;
+	EnergyTermType *weights;
+	for ( i = 0; i < m_num_sites; i++ )
+	{
+		const LabelID l = m_labeling[i];
+		giveNeighborInfo(i,&numN,&nPointer,&weights);
+		for ( n = 0; n < numN; n++ )
+		{
+			const SiteID nSite = nPointer[n];
+			eng += weights[n]*(EnergyTermType)(nSite < i && l != m_labeling[nSite]);
+		}
+	}
+
+	return eng;
+}
+
 //-----------------------------------------------------------------------------------
 
 template <typename DataCostT>
@@ -735,6 +830,13 @@ void GCoptimization::setDataCost(EnergyTermType *dataArray) {
 
 //-------------------------------------------------------------------
 
+void GCoptimization::setDataCost(const short *dataArray) {
+	specializeDataCostFunctor(DataCostFnFromArray16(dataArray, m_num_labels));
+	m_labelingInfoDirty = true;
+}
+
+//-------------------------------------------------------------------
+
 void GCoptimization::setDataCost(SiteID s, LabelID l, EnergyTermType e) {
 	if ( !m_datacostIndividual )
 	{
@@ -803,6 +905,12 @@ void GCoptimization::setSmoothCost(EnergyTermType *smoothArray) {
 
 //-------------------------------------------------------------------
 
+void GCoptimization::setSmoothCostPotts() {
+	specializeSmoothCostFunctor(SmoothCostFnPotts());
+}
+
+//-------------------------------------------------------------------
+
 void GCoptimization::setSmoothCost(LabelID l1, LabelID l2, EnergyTermType e){
 	if ( !m_smoothcostIndividual )
 	{
@@ -1208,56 +1316,59 @@ bool GCoptimization::alpha_expansion(LabelID alpha_label)
 
 	// Determine list of active sites for this expansion move
 	SiteID size = 0;
-	SiteID *activeSites = new SiteID[m_num_sites];
+	SiteID *activeSites = m_activeSites;
 	EnergyType afterExpansionEnergy = 0;
-	try 
-	{
-		// Get list of active sites based on alpha and current labeling
-		if ( m_queryActiveSitesExpansion )
-			size = (this->*m_queryActiveSitesExpansion)(alpha_label,activeSites);
-		if ( size == 0 )  // Nothing to do
-		{
-			delete [] activeSites;
-			printStatus2(alpha_label,-1,size,ticks0);
-			return false;
-		}
 
-		// Initialise reverse-lookup so that non-active neighbours can be identified
-		// while constructing the graph
-		for ( SiteID i = 0; i < size; i++ )
-			m_lookupSiteVar[activeSites[i]] = i;
-
-		// Create binary variables for each remaining site, add the data costs,
-		// and compute the smooth costs between variables.
-		EnergyT e(size+m_labelcostCount, // poor guess at number of pairwise terms needed :(
-				 m_numNeighborsTotal+(m_labelcostCount?size+m_labelcostCount : 0),
-				 handleError);
-		e.add_variable(size);
-		m_beforeExpansionEnergy = 0;
-		if ( m_setupDataCostsExpansion   ) (this->*m_setupDataCostsExpansion  )(size,alpha_label,&e,activeSites);
-		if ( m_setupSmoothCostsExpansion ) (this->*m_setupSmoothCostsExpansion)(size,alpha_label,&e,activeSites);
-		EnergyType alphaCorrection = setupLabelCostsExpansion(size,alpha_label,&e,activeSites);
-		checkInterrupt();
-		afterExpansionEnergy = e.minimize() + alphaCorrection;
-		checkInterrupt();
-
-		if ( afterExpansionEnergy < m_beforeExpansionEnergy )
-			(this->*m_applyNewLabeling)(&e,activeSites,size,alpha_label);
-
-		for ( SiteID i = 0; i < size; i++ )
-			m_lookupSiteVar[activeSites[i]] = -1; // restore m_lookupSite to all -1s
-
-		printStatus2(alpha_label,-1,size,ticks0);
-	} 
-	catch (...)
+	// Get list of active sites based on alpha and current labeling
+	if ( m_queryActiveSitesExpansion )
+		size = (this->*m_queryActiveSitesExpansion)(alpha_label,activeSites);
+	if ( size == 0 )  // Nothing to do
 	{
-		delete [] activeSites;
-		throw;
+		printStatus2(alpha_label,-1,size,ticks0);
+		return false;
 	}
-	delete [] activeSites;
+
+	// Initialise reverse-lookup so that non-active neighbours can be identified
+	// while constructing the graph
+	for ( SiteID i = 0; i < size; i++ )
+		m_lookupSiteVar[activeSites[i]] = i;
+
+	// Create binary variables for each remaining site, add the data costs,
+	// and compute the smooth costs between variables.
+	EnergyT &e = *resetEnergyArena(size+m_labelcostCount, // poor guess at number of pairwise terms needed :(
+				 m_numNeighborsTotal+(m_labelcostCount?size+m_labelcostCount : 0));
+	e.add_variable(size);
+	m_beforeExpansionEnergy = 0;
+	if ( m_setupDataCostsExpansion   ) (this->*m_setupDataCostsExpansion  )(size,alpha_label,&e,activeSites);
+	if ( m_setupSmoothCostsExpansion ) (this->*m_setupSmoothCostsExpansion)(size,alpha_label,&e,activeSites);
+	EnergyType alphaCorrection = setupLabelCostsExpansion(size,alpha_label,&e,activeSites);
+	checkInterrupt();
+	afterExpansionEnergy = e.minimize() + alphaCorrection;
+	checkInterrupt();
+
+	if ( afterExpansionEnergy < m_beforeExpansionEnergy )
+		(this->*m_applyNewLabeling)(&e,activeSites,size,alpha_label);
+
+	for ( SiteID i = 0; i < size; i++ )
+		m_lookupSiteVar[activeSites[i]] = -1; // restore m_lookupSite to all -1s
+
+	printStatus2(alpha_label,-1,size,ticks0);
 	return afterExpansionEnergy < m_beforeExpansionEnergy;
 }
 
+//-------------------------------------------------------------------
+// The graph of each move is built in the same Energy, which keeps its node/arc
+// arrays (and maxflow's orphan blocks) at the largest size seen so far.
+//
+GCoptimization::EnergyT* GCoptimization::resetEnergyArena(SiteID numVars, SiteID numEdges)
+{
+	if ( !m_energyArena )
+		m_energyArena = new EnergyT(numVars,numEdges,handleError);
+	else
+		m_energyArena->reset();
+	return m_energyArena;
+}
+
 //-------------------------------------------------------------------
 
 GCoptimization::EnergyType GCoptimization::oneExpansionIteration()
@@ -1344,49 +1455,39 @@ void GCoptimization::alpha_beta_swap(LabelID alpha_label, LabelID beta_label)
 
 	// Determine the list of active sites for this swap move
 	SiteID size = 0;
-	SiteID *activeSites = new SiteID[m_num_sites];
-	try
+	SiteID *activeSites = m_activeSites;
+	for ( SiteID i = 0; i < m_num_sites; i++ )
 	{
-		for ( SiteID i = 0; i < m_num_sites; i++ )
-		{
-			if ( m_labeling[i] == alpha_label || m_labeling[i] == beta_label )
-			{
-				activeSites[size] = i;
-				m_lookupSiteVar[i] = size;
-				size++;
-			}
-		}
-		if ( size == 0 )
+		if ( m_labeling[i] == alpha_label || m_labeling[i] == beta_label )
 		{
-			delete [] activeSites;
-			printStatus2(alpha_label,beta_label,size,ticks0);
-			return;
+			activeSites[size] = i;
+			m_lookupSiteVar[i] = size;
+			size++;
 		}
+	}
+	if ( size == 0 )
+	{
+		printStatus2(alpha_label,beta_label,size,ticks0);
+		return;
+	}
 
-		// Create binary variables for each remaining site, add the data costs,
-		// and compute the smooth costs between variables.
-		EnergyT e(size,m_numNeighborsTotal,handleError);
-		e.add_variable(size);
-		if ( m_setupDataCostsSwap   ) (this->*m_setupDataCostsSwap  )(size,alpha_label,beta_label,&e,activeSites);
-		if ( m_setupSmoothCostsSwap ) (this->*m_setupSmoothCostsSwap)(size,alpha_label,beta_label,&e,activeSites);
-		checkInterrupt();
-		e.minimize();
-		checkInterrupt();
-		
-		// Apply the new labeling
-		for ( SiteID i = 0; i < size; i++ )
-		{
-			m_labeling[activeSites[i]] = (e.get_var(i) == 0) ? alpha_label : beta_label;
-			m_lookupSiteVar[activeSites[i]] = -1; // restore lookupSiteVar to all -1s
-		}
-		m_labelingInfoDirty = true;
-	} 
-	catch (...)
+	// Create binary variables for each remaining site, add the data costs,
+	// and compute the smooth costs between variables.
+	EnergyT &e = *resetEnergyArena(size,m_numNeighborsTotal);
+	e.add_variable(size);
+	if ( m_setupDataCostsSwap   ) (this->*m_setupDataCostsSwap  )(size,alpha_label,beta_label,&e,activeSites);
+	if ( m_setupSmoothCostsSwap ) (this->*m_setupSmoothCostsSwap)(size,alpha_label,beta_label,&e,activeSites);
+	checkInterrupt();
+	e.minimize();
+	checkInterrupt();
+	
+	// Apply the new labeling
+	for ( SiteID i = 0; i < size; i++ )
 	{
-		delete [] activeSites;
-		throw;
+		m_labeling[activeSites[i]] = (e.get_var(i) == 0) ? alpha_label : beta_label;
+		m_lookupSiteVar[activeSites[i]] = -1; // restore lookupSiteVar to all -1s
 	}
-	delete [] activeSites;
+	m_labelingInfoDirty = true;
 
 	printStatus2(alpha_label,beta_label,size,ticks0);
 }
@@ -208,6 +208,7 @@ public:
 	void setDataCost(DataCostFn fn);
 	void setDataCost(DataCostFnExtra fn, void *extraData);
 	void setDataCost(EnergyTermType *dataArray);
+	void setDataCost(const short *dataArray); // same layout, 16-bit storage (array is not copied)
 	void setDataCost(SiteID s, LabelID l, EnergyTermType e); 
 	void setDataCostFunctor(DataCostFunctor* f);
 	struct DataCostFunctor {
@@ -228,6 +229,9 @@ public:
 	void setSmoothCost(LabelID l1, LabelID l2, EnergyTermType e); 
 	void setSmoothCost(EnergyTermType *smoothArray);
 	void setSmoothCostFunctor(SmoothCostFunctor* f);
+	// Restores the default Potts model, whose expansion/swap graphs are set up
+	// directly from the labels (no table lookup or functor call per edge).
+	void setSmoothCostPotts();
 	struct SmoothCostFunctor {
 		virtual EnergyTermType compute(SiteID s1, SiteID s2, LabelID l1, LabelID l2) = 0;
 	};
@@ -310,6 +314,8 @@ protected:
 	void*   m_datacostFn;
 	void*   m_smoothcostFn;
 	EnergyType m_beforeExpansionEnergy;
+	EnergyT *m_energyArena;              // binary energy of the moves, kept at its high-water capacity
+	SiteID  *m_activeSites;              // sites participating in the current move
 
 	SiteID *m_numNeighbors;              // holds num of neighbors for each site
 	SiteID  m_numNeighborsTotal;         // holds total num of neighbor relationships
@@ -331,6 +337,9 @@ protected:
 	virtual void giveNeighborInfo(SiteID site, SiteID *numSites, SiteID **neighbors, EnergyTermType **weights)=0;
 	virtual void finalizeNeighbors() = 0;
 
+	// returns the energy of the next move, emptied in O(#variables) instead of reallocated
+	EnergyT* resetEnergyArena(SiteID numVars, SiteID numEdges);
+
 	struct DataCostFnFromArray {
 		DataCostFnFromArray(EnergyTermType* theArray, LabelID num_labels)
 			: m_array(theArray), m_num_labels(num_labels){}
@@ -340,6 +349,15 @@ protected:
 		const LabelID m_num_labels;
 	};
 
+	struct DataCostFnFromArray16 {
+		DataCostFnFromArray16(const short* theArray, LabelID num_labels)
+			: m_array(theArray), m_num_labels(num_labels){}
+		OLGA_INLINE EnergyTermType compute(SiteID s, LabelID l){return (EnergyTermType)m_array[s*m_num_labels+l];}
+	private:
+		const short* const m_array;
+		const LabelID m_num_labels;
+	};
+
 	struct DataCostFnFromFunction {
 		DataCostFnFromFunction(DataCostFn fn): m_fn(fn){}
 		OLGA_INLINE EnergyTermType compute(SiteID s, LabelID l){return m_fn(s,l);}
@@ -525,6 +543,11 @@ private:
 	};
 };
 
+// Potts specializations, declared before any use in GCoptimization.cpp
+template <> void GCoptimization::setupSmoothCostsExpansion<GCoptimization::SmoothCostFnPotts>(SiteID size,LabelID alpha_label,EnergyT *e,SiteID *activeSites);
+template <> void GCoptimization::setupSmoothCostsSwap<GCoptimization::SmoothCostFnPotts>(SiteID size,LabelID alpha_label,LabelID beta_label,EnergyT *e,SiteID *activeSites);
+template <> GCoptimization::EnergyType GCoptimization::giveSmoothEnergyInternal<GCoptimization::SmoothCostFnPotts>();
+
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // Use this derived class for grid graphs
@@ -75,10 +75,26 @@
 
 #include <assert.h>
 #include "graph.h"
+#include "ibfs.h"
+
+/* Maxflow backend of Energy, chosen at compile time:
+     Graph     - Boykov-Kolmogorov augmenting paths (graph.h, default)
+     IBFSGraph - Incremental Breadth-First Search (ibfs.h), define GCO_MAXFLOW_IBFS
+   Any class template with the same node/edge/t-link interface can be plugged in
+   by defining GCO_MAXFLOW_GRAPH before including this header. */
+#ifndef GCO_MAXFLOW_GRAPH
+#ifdef GCO_MAXFLOW_IBFS
+#define GCO_MAXFLOW_GRAPH IBFSGraph
+#else
+#define GCO_MAXFLOW_GRAPH Graph
+#endif
+#endif
 
-template <typename captype, typename tcaptype, typename flowtype> class Energy: public Graph<captype,tcaptype,flowtype>
+template <typename captype, typename tcaptype, typename flowtype,
+          template <typename, typename, typename> class MaxflowGraph = GCO_MAXFLOW_GRAPH>
+class Energy: public MaxflowGraph<captype,tcaptype,flowtype>
 {
-	typedef Graph<captype,tcaptype,flowtype> GraphT;
+	typedef MaxflowGraph<captype,tcaptype,flowtype> GraphT;
 public:
 	typedef typename GraphT::node_id Var;
 
@@ -98,6 +114,10 @@ public:
 	   argument is omitted, exit(1) will be called. */
 	Energy(int var_num_max, int edge_num_max, void (*err_function)(const char *) = NULL);
 
+	/* Removes all variables and terms but keeps the allocated memory,
+	   so that one Energy can be reused for a sequence of problems. */
+	void reset();
+
 	/* Destructor */
 	~Energy();
 
@@ -183,32 +203,39 @@ private:
 /************************  Implementation ******************************/
 /***********************************************************************/
 
-template <typename captype, typename tcaptype, typename flowtype> 
-inline Energy<captype,tcaptype,flowtype>::Energy(int var_num_max, int edge_num_max, void (*err_function)(const char *)) : Graph<captype,tcaptype,flowtype>(var_num_max, edge_num_max, err_function)
+template <typename captype, typename tcaptype, typename flowtype, template <typename, typename, typename> class MaxflowGraph> 
+inline Energy<captype,tcaptype,flowtype,MaxflowGraph>::Energy(int var_num_max, int edge_num_max, void (*err_function)(const char *)) : GraphT(var_num_max, edge_num_max, err_function)
 {
 	Econst = 0;
 	error_function = err_function;
 }
 
-template <typename captype, typename tcaptype, typename flowtype> 
-inline Energy<captype,tcaptype,flowtype>::~Energy() {}
+template <typename captype, typename tcaptype, typename flowtype, template <typename, typename, typename> class MaxflowGraph> 
+inline Energy<captype,tcaptype,flowtype,MaxflowGraph>::~Energy() {}
+
+template <typename captype, typename tcaptype, typename flowtype, template <typename, typename, typename> class MaxflowGraph> 
+inline void Energy<captype,tcaptype,flowtype,MaxflowGraph>::reset()
+{
+	GraphT::reset();
+	Econst = 0;
+}
 
-template <typename captype, typename tcaptype, typename flowtype> 
-inline typename Energy<captype,tcaptype,flowtype>::Var Energy<captype,tcaptype,flowtype>::add_variable(int num) 
+template <typename captype, typename tcaptype, typename flowtype, template <typename, typename, typename> class MaxflowGraph> 
+inline typename Energy<captype,tcaptype,flowtype,MaxflowGraph>::Var Energy<captype,tcaptype,flowtype,MaxflowGraph>::add_variable(int num) 
 {	return GraphT::add_node(num); }
 
-template <typename captype, typename tcaptype, typename flowtype> 
-inline void Energy<captype,tcaptype,flowtype>::add_constant(Value A) { Econst += A; }
+template <typename captype, typename tcaptype, typename flowtype, template <typename, typename, typename> class MaxflowGraph> 
+inline void Energy<captype,tcaptype,flowtype,MaxflowGraph>::add_constant(Value A) { Econst += A; }
 
-template <typename captype, typename tcaptype, typename flowtype> 
-inline void Energy<captype,tcaptype,flowtype>::add_term1(Var x,
+template <typename captype, typename tcaptype, typename flowtype, template <typename, typename, typename> class MaxflowGraph> 
+inline void Energy<captype,tcaptype,flowtype,MaxflowGraph>::add_term1(Var x,
                               Value A, Value B)
 {
 	this->add_tweights(x, B, A);
 }
 
-template <typename captype, typename tcaptype, typename flowtype> 
-inline void Energy<captype,tcaptype,flowtype>::add_term2(Var x, Var y,
+template <typename captype, typename tcaptype, typename flowtype, template <typename, typename, typename> class MaxflowGraph> 
+inline void Energy<captype,tcaptype,flowtype,MaxflowGraph>::add_term2(Var x, Var y,
                               Value A, Value B,
                               Value C, Value D)
 {
@@ -252,8 +279,8 @@ inline void Energy<captype,tcaptype,flowtype>::add_term2(Var x, Var y,
 	}
 }
 
-template <typename captype, typename tcaptype, typename flowtype> 
-inline void Energy<captype,tcaptype,flowtype>::add_term3(Var x, Var y, Var z,
+template <typename captype, typename tcaptype, typename flowtype, template <typename, typename, typename> class MaxflowGraph> 
+inline void Energy<captype,tcaptype,flowtype,MaxflowGraph>::add_term3(Var x, Var y, Var z,
                               Value E000, Value E001,
                               Value E010, Value E011,
                               Value E100, Value E101,
@@ -320,11 +347,11 @@ inline void Energy<captype,tcaptype,flowtype>::add_term3(Var x, Var y, Var z,
 	}
 }
 
-template <typename captype, typename tcaptype, typename flowtype> 
-inline typename Energy<captype,tcaptype,flowtype>::TotalValue Energy<captype,tcaptype,flowtype>::minimize() { 
+template <typename captype, typename tcaptype, typename flowtype, template <typename, typename, typename> class MaxflowGraph> 
+inline typename Energy<captype,tcaptype,flowtype,MaxflowGraph>::TotalValue Energy<captype,tcaptype,flowtype,MaxflowGraph>::minimize() { 
 return Econst + GraphT::maxflow(); }
 
-template <typename captype, typename tcaptype, typename flowtype> 
-inline int Energy<captype,tcaptype,flowtype>::get_var(Var x) { return (int) this->what_segment(x); }
+template <typename captype, typename tcaptype, typename flowtype, template <typename, typename, typename> class MaxflowGraph> 
+inline int Energy<captype,tcaptype,flowtype,MaxflowGraph>::get_var(Var x) { return (int) this->what_segment(x); }
 
 #endif
@@ -48,11 +48,7 @@ template <typename captype, typename tcaptype, typename flowtype>
 	arc_last = arcs;
 	node_num = 0;
 
-	if (nodeptr_block) 
-	{ 
-		delete nodeptr_block; 
-		nodeptr_block = NULL; 
-	}
+	// node/arc arrays and the orphan blocks (all free after maxflow) are kept for reuse
 
 	maxflow_iteration = 0;
 	flow = 0;
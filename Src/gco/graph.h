@@ -135,7 +135,8 @@ public:
 	// After that functions add_node() and add_edge() must be called again. 
 	//
 	// Advantage compared to deleting Graph and allocating it again:
-	// no calls to delete/new (which could be quite slow).
+	// no calls to delete/new (which could be quite slow), the node and arc
+	// arrays keep their largest size so far.
 	//
 	// If the graph structure stays the same, then an alternative
 	// is to go through all nodes/edges and set new residual capacities
@@ -0,0 +1,409 @@
+/* ibfs.h */
+/*
+	This file implements the Incremental Breadth-First Search maxflow
+	algorithm described in
+
+		"Maximum Flows by Incremental Breadth-First Search."
+		Andrew V. Goldberg, Sagi Hed, Haim Kaplan, Robert E. Tarjan, Renato F. Werneck.
+		In European Symposium on Algorithms (ESA), 2011
+
+	as an alternative backend of Energy (see energy.h). The interface is the
+	subset of Graph (graph.h) used by Energy and GCoptimization, so the two
+	classes can be swapped at compile time.
+
+	Like BK, IBFS grows a source tree S and a sink tree T and augments along
+	S-T paths. Unlike BK, the trees are grown one breadth-first layer at a
+	time (the smaller side first) and every node keeps its exact distance
+	label to its terminal, which bounds the work spent on orphans and gives
+	a strongly polynomial O(n^2 m) running time (BK's bound depends on the
+	cut value).
+*/
+
+#ifndef __IBFS_H__
+#define __IBFS_H__
+
+#include <assert.h>
+#include <vector>
+
+template <typename captype, typename tcaptype, typename flowtype> class IBFSGraph
+{
+public:
+	typedef enum
+	{
+		SOURCE	= 0,
+		SINK	= 1
+	} termtype; // terminals, same values as Graph::termtype
+	typedef int node_id;
+
+	// Same meaning as in Graph: the sizes are estimates used to reserve memory.
+	IBFSGraph(int node_num_max, int edge_num_max, void (*err_function)(const char *) = NULL);
+	~IBFSGraph() {}
+
+	// Adds node(s) to the graph, returns the node_id of the first one.
+	node_id add_node(int num = 1);
+
+	// Adds a bidirectional edge between 'i' and 'j' with the weights 'cap' and 'rev_cap'.
+	void add_edge(node_id i, node_id j, captype cap, captype rev_cap);
+
+	// Adds new edges 'SOURCE->i' and 'i->SINK' with corresponding weights.
+	// Can be called multiple times for each node, weights can be negative.
+	void add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	// Computes the maxflow. Can be called several times, edges and t-links
+	// added in between are taken into account.
+	flowtype maxflow();
+
+	// After the maxflow is computed, returns to which segment the node 'i'
+	// belongs. Nodes reachable from the source in the residual graph are
+	// SOURCE, nodes that reach the sink are SINK, default_segm otherwise.
+	termtype what_segment(node_id i, termtype default_segm = SOURCE);
+
+	// Removes all nodes and edges, the memory is kept for the next graph.
+	void reset();
+
+	int get_node_num() { return node_num; }
+	int get_arc_num() { return (int)arc_head.size(); }
+
+private:
+	enum { TREE_FREE = 0, TREE_S = 1, TREE_T = 2 };
+	enum { PARENT_TERMINAL = -1, PARENT_ORPHAN = -2 };
+
+	int						node_num;
+	void					(*error_function)(const char *);
+	flowtype				flow;
+
+	// arcs in insertion order, arc 2k is i->j and arc 2k+1 (its sister) is j->i
+	std::vector<node_id>	arc_tail;
+	std::vector<node_id>	arc_head;
+	std::vector<captype>	arc_rcap;
+
+	// outgoing arcs of each node (CSR over arc ids), rebuilt when arcs were added
+	bool					csr_dirty;
+	std::vector<int>		out_first;
+	std::vector<int>		out_arcs;
+
+	// per node state
+	std::vector<tcaptype>	tr_cap;		// > 0: residual of SOURCE->i, < 0: -residual of i->SINK
+	std::vector<char>		tree;		// TREE_FREE, TREE_S or TREE_T
+	std::vector<int>		dist;		// distance label to the terminal of its tree
+	std::vector<int>		parent;		// arc i->parent, PARENT_TERMINAL or PARENT_ORPHAN
+	std::vector<int>		cur;		// current arc (position in out_arcs) for adoption
+	std::vector<char>		segment;	// result of the last maxflow, -1 if undetermined
+
+	// search state
+	int						D[3];		// frontier label of each tree
+	bool					growing[3];	// tree being grown by the current pass
+	std::vector<node_id>	active[3];	// unscanned nodes of the frontier of each tree
+	std::vector<node_id>	orphans;
+	std::vector<int>		scratch;	// scanned layer / BFS queue / CSR fill positions
+
+	void build_csr();
+	captype res_to(int tr, int a);		// residual capacity usable by tree 'tr' along its arc a
+	void augment(node_id x, node_id y, int a);
+	void process_orphans(int tr);
+	void compute_segments();
+};
+
+
+
+/***********************************************************************/
+/************************  Implementation ******************************/
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	IBFSGraph<captype,tcaptype,flowtype>::IBFSGraph(int node_num_max, int edge_num_max, void (*err_function)(const char *))
+	: node_num(0),
+	  error_function(err_function),
+	  flow(0),
+	  csr_dirty(true)
+{
+	if (node_num_max < 16) node_num_max = 16;
+	if (edge_num_max < 16) edge_num_max = 16;
+
+	tr_cap.reserve(node_num_max);
+	arc_tail.reserve(2*edge_num_max);
+	arc_head.reserve(2*edge_num_max);
+	arc_rcap.reserve(2*edge_num_max);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::reset()
+{
+	node_num = 0;
+	flow = 0;
+	csr_dirty = true;
+	tr_cap.clear();
+	arc_tail.clear();
+	arc_head.clear();
+	arc_rcap.clear();
+	segment.clear();
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline typename IBFSGraph<captype,tcaptype,flowtype>::node_id IBFSGraph<captype,tcaptype,flowtype>::add_node(int num)
+{
+	assert(num > 0);
+
+	node_id i = node_num;
+	node_num += num;
+	tr_cap.resize(node_num, 0);
+	csr_dirty = true;
+	return i;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void IBFSGraph<captype,tcaptype,flowtype>::add_edge(node_id i, node_id j, captype cap, captype rev_cap)
+{
+	assert(i >= 0 && i < node_num);
+	assert(j >= 0 && j < node_num);
+	assert(i != j);
+	assert(cap >= 0);
+	assert(rev_cap >= 0);
+
+	arc_tail.push_back(i); arc_head.push_back(j); arc_rcap.push_back(cap);
+	arc_tail.push_back(j); arc_head.push_back(i); arc_rcap.push_back(rev_cap);
+	csr_dirty = true;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void IBFSGraph<captype,tcaptype,flowtype>::add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
+{
+	assert(i >= 0 && i < node_num);
+
+	tcaptype delta = tr_cap[i];
+	if (delta > 0) cap_source += delta;
+	else           cap_sink   -= delta;
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	tr_cap[i] = cap_source - cap_sink;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline typename IBFSGraph<captype,tcaptype,flowtype>::termtype IBFSGraph<captype,tcaptype,flowtype>::what_segment(node_id i, termtype default_segm)
+{
+	if (i < 0 || i >= (int)segment.size() || segment[i] < 0)
+		return default_segm;
+	return (termtype)segment[i];
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline captype IBFSGraph<captype,tcaptype,flowtype>::res_to(int tr, int a)
+{
+	// S carries flow from tail to head of its arcs, T from head to tail
+	return (tr == TREE_S) ? arc_rcap[a] : arc_rcap[a^1];
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::build_csr()
+{
+	const int arc_num = (int)arc_head.size();
+
+	out_first.assign(node_num + 1, 0);
+	for (int a = 0; a < arc_num; ++a)
+		++out_first[arc_tail[a] + 1];
+	for (int i = 0; i < node_num; ++i)
+		out_first[i + 1] += out_first[i];
+
+	scratch.assign(out_first.begin(), out_first.end() - 1);
+	out_arcs.resize(arc_num);
+	for (int a = 0; a < arc_num; ++a)
+		out_arcs[scratch[arc_tail[a]]++] = a;
+
+	tree.resize(node_num);
+	dist.resize(node_num);
+	parent.resize(node_num);
+	cur.resize(node_num);
+	csr_dirty = false;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::augment(node_id x, node_id y, int a)
+{
+	// x is in S, y is in T and a = x->y has residual capacity
+	tcaptype bottleneck = arc_rcap[a];
+	node_id i;
+	int pa;
+
+	for (i = x; (pa = parent[i]) >= 0; i = arc_head[pa])
+		if (bottleneck > arc_rcap[pa^1]) bottleneck = arc_rcap[pa^1];
+	if (bottleneck > tr_cap[i]) bottleneck = tr_cap[i];
+
+	for (i = y; (pa = parent[i]) >= 0; i = arc_head[pa])
+		if (bottleneck > arc_rcap[pa]) bottleneck = arc_rcap[pa];
+	if (bottleneck > -tr_cap[i]) bottleneck = -tr_cap[i];
+
+	// push the flow, saturated tree arcs make orphans of their children
+	arc_rcap[a] -= bottleneck;
+	arc_rcap[a^1] += bottleneck;
+
+	for (i = x; (pa = parent[i]) >= 0; i = arc_head[pa]) {
+		arc_rcap[pa^1] -= bottleneck;
+		arc_rcap[pa] += bottleneck;
+		if (arc_rcap[pa^1] == 0) { parent[i] = PARENT_ORPHAN; orphans.push_back(i); }
+	}
+	tr_cap[i] -= bottleneck;
+	if (tr_cap[i] == 0) { parent[i] = PARENT_ORPHAN; orphans.push_back(i); }
+	process_orphans(TREE_S);
+
+	for (i = y; (pa = parent[i]) >= 0; i = arc_head[pa]) {
+		arc_rcap[pa] -= bottleneck;
+		arc_rcap[pa^1] += bottleneck;
+		if (arc_rcap[pa] == 0) { parent[i] = PARENT_ORPHAN; orphans.push_back(i); }
+	}
+	tr_cap[i] += bottleneck;
+	if (tr_cap[i] == 0) { parent[i] = PARENT_ORPHAN; orphans.push_back(i); }
+	process_orphans(TREE_T);
+
+	flow += bottleneck;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::process_orphans(int tr)
+{
+	// Labels never decrease. An orphan first tries to keep its label through
+	// a neighbor one layer closer to the terminal (scanning from its current
+	// arc), then relabels to the closest neighbor of its tree, or leaves the
+	// tree if that neighbor is beyond the frontier.
+	const int maxLabel = growing[tr] ? D[tr] + 1 : D[tr];
+
+	for (size_t k = 0; k < orphans.size(); ++k) {
+		const node_id v = orphans[k];
+		const int d = dist[v];
+		const int end = out_first[v + 1];
+		int found = -1;
+
+		for (int p = cur[v]; p < end; ++p) {
+			const int a = out_arcs[p], u = arc_head[a];
+			if (tree[u] == tr && dist[u] == d - 1 && res_to(tr, a^1) > 0) {
+				found = p;
+				break;
+			}
+		}
+		if (found >= 0) {
+			cur[v] = found;
+			parent[v] = out_arcs[found];
+			continue;
+		}
+
+		// relabel
+		int minLabel = maxLabel;
+		for (int p = out_first[v]; p < end; ++p) {
+			const int a = out_arcs[p], u = arc_head[a];
+			if (tree[u] == tr && dist[u] < minLabel && res_to(tr, a^1) > 0) {
+				minLabel = dist[u];
+				found = p;
+			}
+		}
+
+		// children of v become orphans
+		for (int p = out_first[v]; p < end; ++p) {
+			const int a = out_arcs[p], w = arc_head[a];
+			if (tree[w] == tr && parent[w] == (a^1)) {
+				parent[w] = PARENT_ORPHAN;
+				orphans.push_back(w);
+			}
+		}
+
+		if (found < 0) {
+			tree[v] = TREE_FREE;
+			continue;
+		}
+		dist[v] = minLabel + 1;
+		cur[v] = found;
+		parent[v] = out_arcs[found];
+		if (dist[v] == maxLabel)
+			active[tr].push_back(v);
+	}
+	orphans.clear();
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype IBFSGraph<captype,tcaptype,flowtype>::maxflow()
+{
+	if (csr_dirty)
+		build_csr();
+
+	// -- Roots are the nodes with residual t-links
+	for (int tr = TREE_S; tr <= TREE_T; ++tr) {
+		D[tr] = 0;
+		growing[tr] = false;
+		active[tr].clear();
+	}
+	for (node_id i = 0; i < node_num; ++i) {
+		cur[i] = out_first[i];
+		dist[i] = 0;
+		parent[i] = PARENT_TERMINAL;
+		if (tr_cap[i] > 0)      { tree[i] = TREE_S; active[TREE_S].push_back(i); }
+		else if (tr_cap[i] < 0) { tree[i] = TREE_T; active[TREE_T].push_back(i); }
+		else                      tree[i] = TREE_FREE;
+	}
+
+	// -- Grow the smaller frontier by one layer until one tree is closed
+	std::vector<node_id> &layer = scratch;
+	while (!active[TREE_S].empty() && !active[TREE_T].empty()) {
+		const int tr = active[TREE_S].size() <= active[TREE_T].size() ? TREE_S : TREE_T;
+		const int d = D[tr];
+		layer.swap(active[tr]);
+		active[tr].clear();
+		growing[tr] = true;
+
+		for (size_t k = 0; k < layer.size(); ++k) {
+			const node_id v = layer[k];
+			int p = out_first[v];
+			while (tree[v] == tr && dist[v] == d && parent[v] != PARENT_ORPHAN && p < out_first[v + 1]) {
+				const int a = out_arcs[p], u = arc_head[a];
+				if (res_to(tr, a) == 0 || tree[u] == tr) {
+					++p;
+					continue;
+				}
+				if (tree[u] == TREE_FREE) {
+					tree[u] = tr;
+					dist[u] = d + 1;
+					parent[u] = a^1;
+					cur[u] = out_first[u];
+					active[tr].push_back(u);
+					++p;
+					continue;
+				}
+				// the trees touch, keep using the arc while it has residual capacity
+				if (tr == TREE_S) augment(v, u, a);
+				else              augment(u, v, a^1);
+			}
+		}
+
+		growing[tr] = false;
+		D[tr] = d + 1;
+	}
+
+	compute_segments();
+	return flow;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void IBFSGraph<captype,tcaptype,flowtype>::compute_segments()
+{
+	// Residual reachability from each terminal gives the two extreme
+	// minimum cuts; nodes in neither set may go to either side.
+	std::vector<node_id> &queue = scratch;
+	segment.assign(node_num, -1);
+
+	for (int side = SOURCE; side <= SINK; ++side) {
+		queue.clear();
+		for (node_id i = 0; i < node_num; ++i)
+			if ((side == SOURCE && tr_cap[i] > 0) || (side == SINK && tr_cap[i] < 0)) {
+				segment[i] = (char)side;
+				queue.push_back(i);
+			}
+		for (size_t k = 0; k < queue.size(); ++k) {
+			const node_id v = queue[k];
+			for (int p = out_first[v]; p < out_first[v + 1]; ++p) {
+				const int a = out_arcs[p], u = arc_head[a];
+				if (segment[u] < 0 && (side == SOURCE ? arc_rcap[a] : arc_rcap[a^1]) > 0) {
+					segment[u] = (char)side;
+					queue.push_back(u);
+				}
+			}
+		}
+	}
+}
+
+#endif
@@ -593,7 +593,9 @@ template <typename captype, typename tcaptype, typename flowtype>
 	}
 	// test_consistency();
 
-	if (!reuse_trees || (maxflow_iteration % 64) == 0)
+	// Every orphan has been returned to nodeptr_block, keep its memory for the next
+	// maxflow() (e.g. after reset()) unless reused trees may have made it grow
+	if (reuse_trees && (maxflow_iteration % 64) == 0)
 	{
 		delete nodeptr_block; 
 		nodeptr_block = NULL; 
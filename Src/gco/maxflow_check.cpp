@@ -0,0 +1,308 @@
+//////////////////////////////////////////////////////////////////////////////
+// Cross-check of the maxflow backends of GCoptimization.cpp
+//
+/////////////////////////////////////////////////////////////////////////////
+//
+//  Every expansion/swap move of GCoptimization is a binary min-cut subproblem.
+//  This program plugs a checking policy into Energy (see energy.h) which builds
+//  each subproblem in both Graph (Boykov-Kolmogorov) and IBFSGraph, solves it
+//  with both solvers and verifies that
+//    - the two flow values are equal, and
+//    - the cut returned by each solver costs exactly its flow (i.e. is minimal).
+//  Moves are applied from the BK cut, so the optimization itself runs exactly
+//  as in the default build.
+//
+//  The model mimics the MMF-GCO one (PointCloudFitUtil_MMFGCO.cpp): points
+//  sampled on a few planes plus clutter, a k-nearest-neighbor graph with Potts
+//  smoothness, label 0 for noise and one label with a label cost for each
+//  candidate plane (the true planes and slightly perturbed copies).
+//
+//  Stand-alone program, it is not part of PCF.vcxproj:
+//    g++ -O2 maxflow_check.cpp LinkedBlockList.cpp -o maxflow_check
+//    cl /O2 /EHsc maxflow_check.cpp LinkedBlockList.cpp
+//  Usage:
+//    maxflow_check [#points=20000] [#planes=8] [#neighbors=8] [seed=1]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include "graph.h"
+#include "ibfs.h"
+
+struct MaxflowCheckStats
+{
+	int numProblem;
+	int numMismatch;	// flow(BK) != flow(IBFS)
+	int numBadCut;		// cut value != flow value
+	long long numNode;
+	long long numArc;
+	double timeBK;
+	double timeIBFS;
+};
+static MaxflowCheckStats g_stats = { 0, 0, 0, 0, 0, 0.0, 0.0 };
+
+template <typename captype, typename tcaptype, typename flowtype>
+class MaxflowCheckGraph : public Graph<captype,tcaptype,flowtype>
+{
+	typedef Graph<captype,tcaptype,flowtype> BKGraph;
+	typedef IBFSGraph<captype,tcaptype,flowtype> IBGraph;
+public:
+	typedef typename BKGraph::node_id node_id;
+
+	MaxflowCheckGraph(int node_num_max, int edge_num_max, void (*err_function)(const char *) = NULL)
+		: BKGraph(node_num_max, edge_num_max, err_function), m_ibfs(node_num_max, edge_num_max, err_function) {}
+
+	node_id add_node(int num = 1)
+	{
+		m_ibfs.add_node(num);
+		m_tSource.resize(m_tSource.size() + num, 0);
+		m_tSink.resize(m_tSink.size() + num, 0);
+		return BKGraph::add_node(num);
+	}
+
+	void add_edge(node_id i, node_id j, captype cap, captype rev_cap)
+	{
+		Edge e = { i, j, cap, rev_cap };
+		m_edges.push_back(e);
+		m_ibfs.add_edge(i, j, cap, rev_cap);
+		BKGraph::add_edge(i, j, cap, rev_cap);
+	}
+
+	void add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink)
+	{
+		m_tSource[i] += cap_source;
+		m_tSink[i] += cap_sink;
+		m_ibfs.add_tweights(i, cap_source, cap_sink);
+		BKGraph::add_tweights(i, cap_source, cap_sink);
+	}
+
+	void reset()
+	{
+		m_ibfs.reset();
+		m_edges.clear();
+		m_tSource.clear();
+		m_tSink.clear();
+		BKGraph::reset();
+	}
+
+	flowtype maxflow()
+	{
+		clock_t t0 = clock();
+		flowtype flowBK = BKGraph::maxflow();
+		clock_t t1 = clock();
+		flowtype flowIBFS = m_ibfs.maxflow();
+		clock_t t2 = clock();
+
+		std::vector<int> segBK(m_tSource.size()), segIBFS(m_tSource.size());
+		for (size_t i = 0; i < m_tSource.size(); ++i) {
+			segBK[i] = (int)BKGraph::what_segment((node_id)i);
+			segIBFS[i] = (int)m_ibfs.what_segment((node_id)i);
+		}
+
+		++g_stats.numProblem;
+		g_stats.numNode += m_tSource.size();
+		g_stats.numArc += 2*m_edges.size();
+		g_stats.timeBK += double(t1 - t0)/CLOCKS_PER_SEC;
+		g_stats.timeIBFS += double(t2 - t1)/CLOCKS_PER_SEC;
+		if (flowBK != flowIBFS) {
+			++g_stats.numMismatch;
+			printf("  ! subproblem %d: flow BK %lld != IBFS %lld\n", g_stats.numProblem, (long long)flowBK, (long long)flowIBFS);
+		}
+		if (cutValue(segBK) != flowBK || cutValue(segIBFS) != flowIBFS) {
+			++g_stats.numBadCut;
+			printf("  ! subproblem %d: cut BK %lld / IBFS %lld is not minimal\n", g_stats.numProblem, (long long)cutValue(segBK), (long long)cutValue(segIBFS));
+		}
+		return flowBK;
+	}
+
+private:
+	struct Edge { node_id i, j; captype cap, rev_cap; };
+
+	IBGraph m_ibfs;
+	std::vector<Edge> m_edges;
+	std::vector<tcaptype> m_tSource;
+	std::vector<tcaptype> m_tSink;
+
+	// cost of the cut given by seg (0 = SOURCE, 1 = SINK) in the original network
+	flowtype cutValue(const std::vector<int> &seg)
+	{
+		flowtype cut = 0;
+		for (size_t i = 0; i < seg.size(); ++i)
+			cut += seg[i] ? m_tSource[i] : m_tSink[i];
+		for (size_t k = 0; k < m_edges.size(); ++k) {
+			const Edge &e = m_edges[k];
+			if (seg[e.i] == 0 && seg[e.j] == 1) cut += e.cap;
+			if (seg[e.i] == 1 && seg[e.j] == 0) cut += e.rev_cap;
+		}
+		return cut;
+	}
+};
+
+#define GCO_MAXFLOW_GRAPH MaxflowCheckGraph
+#include "GCoptimization.cpp"
+
+
+static double frand() { return rand() / (double)RAND_MAX; }
+static double grand() { return sqrt(-2.0*log(frand()*0.999 + 0.0005))*cos(6.2831853*frand()); }
+
+struct Plane { double n[3], d; };
+
+static double planeDis(const Plane &pl, const double *p)
+{
+	return fabs(pl.n[0]*p[0] + pl.n[1]*p[1] + pl.n[2]*p[2] + pl.d);
+}
+
+static Plane randomPlane()
+{
+	Plane pl;
+	double len = 0.0;
+	for (int k = 0; k < 3; ++k) { pl.n[k] = grand(); len += pl.n[k]*pl.n[k]; }
+	len = sqrt(len);
+	for (int k = 0; k < 3; ++k) pl.n[k] /= len;
+	pl.d = (frand() - 0.5)*0.8;
+	return pl;
+}
+
+static Plane perturbPlane(const Plane &pl, double s)
+{
+	Plane q = pl;
+	double len = 0.0;
+	for (int k = 0; k < 3; ++k) { q.n[k] += s*grand(); len += q.n[k]*q.n[k]; }
+	len = sqrt(len);
+	for (int k = 0; k < 3; ++k) q.n[k] /= len;
+	q.d += 0.2*s*grand();
+	return q;
+}
+
+// k-nearest neighbors on a uniform grid over [-1,1]^3, returned as unique pairs (i<j)
+static void knnPairs(const std::vector<double> &pts, int numNeighbors, std::vector<std::pair<int,int> > &pairs)
+{
+	const int N = (int)pts.size()/3, G = 32;
+	const double cell = 2.0/G;
+	std::vector<int> cellOf(N), first(G*G*G + 1, 0), items(N);
+	for (int i = 0; i < N; ++i) {
+		int c[3];
+		for (int k = 0; k < 3; ++k) c[k] = std::min(G - 1, std::max(0, (int)((pts[3*i + k] + 1.0)/cell)));
+		cellOf[i] = (c[0]*G + c[1])*G + c[2];
+		++first[cellOf[i] + 1];
+	}
+	for (int c = 0; c < G*G*G; ++c) first[c + 1] += first[c];
+	std::vector<int> fill(first.begin(), first.end() - 1);
+	for (int i = 0; i < N; ++i) items[fill[cellOf[i]]++] = i;
+
+	std::vector<std::pair<double,int> > cand;
+	for (int i = 0; i < N; ++i) {
+		const int cx = cellOf[i]/(G*G), cy = (cellOf[i]/G)%G, cz = cellOf[i]%G;
+		cand.clear();
+		for (int x = std::max(0, cx - 1); x <= std::min(G - 1, cx + 1); ++x)
+		for (int y = std::max(0, cy - 1); y <= std::min(G - 1, cy + 1); ++y)
+		for (int z = std::max(0, cz - 1); z <= std::min(G - 1, cz + 1); ++z) {
+			const int c = (x*G + y)*G + z;
+			for (int t = first[c]; t < first[c + 1]; ++t) {
+				const int j = items[t];
+				if (j == i) continue;
+				double d2 = 0.0;
+				for (int k = 0; k < 3; ++k) d2 += (pts[3*i + k] - pts[3*j + k])*(pts[3*i + k] - pts[3*j + k]);
+				cand.push_back(std::make_pair(d2, j));
+			}
+		}
+		const int K = std::min(numNeighbors, (int)cand.size());
+		std::partial_sort(cand.begin(), cand.begin() + K, cand.end());
+		for (int t = 0; t < K; ++t)
+			pairs.push_back(std::make_pair(std::min(i, cand[t].second), std::max(i, cand[t].second)));
+	}
+	std::sort(pairs.begin(), pairs.end());
+	pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+}
+
+int main(int argc, char **argv)
+{
+	const int numPoints = argc > 1 ? atoi(argv[1]) : 20000;
+	const int numPlanes = argc > 2 ? atoi(argv[2]) : 8;
+	const int numNeighbors = argc > 3 ? atoi(argv[3]) : 8;
+	srand(argc > 4 ? atoi(argv[4]) : 1);
+
+	const double T = 0.01;				// inlier distance
+	const int costScale = 1000, costNoise = 1500, lambda = 800, labelCost = 20000;
+
+	// -- Sample points on planes (clipped to the cube) plus 10% clutter
+	std::vector<Plane> planes(numPlanes);
+	for (int k = 0; k < numPlanes; ++k)
+		planes[k] = randomPlane();
+	std::vector<double> pts;
+	pts.reserve(3*numPoints);
+	while ((int)pts.size() < 3*numPoints) {
+		double p[3] = { 2*frand() - 1, 2*frand() - 1, 2*frand() - 1 };
+		if (frand() > 0.1) {
+			const Plane &pl = planes[rand()%numPlanes];
+			const double s = pl.n[0]*p[0] + pl.n[1]*p[1] + pl.n[2]*p[2] + pl.d - 0.3*T*grand();
+			for (int k = 0; k < 3; ++k) p[k] -= s*pl.n[k];
+			if (fabs(p[0]) > 1 || fabs(p[1]) > 1 || fabs(p[2]) > 1) continue;
+		}
+		pts.insert(pts.end(), p, p + 3);
+	}
+
+	// -- Candidates: each plane and two perturbed copies, label 0 is noise
+	std::vector<Plane> cands;
+	for (int k = 0; k < numPlanes; ++k) {
+		cands.push_back(planes[k]);
+		cands.push_back(perturbPlane(planes[k], 0.02));
+		cands.push_back(perturbPlane(planes[k], 0.05));
+	}
+	const int numLabels = (int)cands.size() + 1;
+
+	std::vector<int> dataCost((size_t)numPoints*numLabels);
+	for (int i = 0; i < numPoints; ++i) {
+		dataCost[(size_t)i*numLabels] = costNoise;
+		for (int l = 1; l < numLabels; ++l) {
+			const double r = planeDis(cands[l - 1], &pts[3*i])/T;
+			dataCost[(size_t)i*numLabels + l] = r < 1 ? int(costScale*r*r) : int(costScale*std::min(1.0 + 4*(r - 1), 20.0));
+		}
+	}
+	std::vector<int> labelCosts(numLabels, labelCost);
+	labelCosts[0] = 0;
+
+	std::vector<std::pair<int,int> > pairs;
+	knnPairs(pts, numNeighbors, pairs);
+
+	printf("maxflow_check: #Points %d, #Labels %d, #Edges %d\n", numPoints, numLabels, (int)pairs.size());
+
+	try {
+		for (int run = 0; run < 2; ++run) {
+			GCoptimizationGeneralGraph gc(numPoints, numLabels);
+			gc.setDataCost(&dataCost[0]);
+			for (int l1 = 0; l1 < numLabels; ++l1)
+				for (int l2 = 0; l2 < numLabels; ++l2)
+					gc.setSmoothCost(l1, l2, l1 == l2 ? 0 : lambda);
+			for (size_t k = 0; k < pairs.size(); ++k)
+				gc.setNeighbors(pairs[k].first, pairs[k].second);
+
+			// expansion with label costs, then alpha-beta swap (no label costs)
+			GCoptimization::EnergyType energy;
+			if (run == 0) {
+				gc.setLabelCost(&labelCosts[0]);
+				gc.setLabelOrder(true);
+				energy = gc.expansion(5);
+			}
+			else
+				energy = gc.swap(2);
+			printf("  %-9s : E = %lld, #Subproblems so far %d\n", run == 0 ? "Expansion" : "Swap", (long long)energy, g_stats.numProblem);
+		}
+	}
+	catch (GCException e) {
+		e.Report();
+		return 2;
+	}
+
+	printf("  #Subproblems : %d (avg. %lld nodes, %lld arcs)\n", g_stats.numProblem,
+		g_stats.numProblem ? g_stats.numNode/g_stats.numProblem : 0, g_stats.numProblem ? g_stats.numArc/g_stats.numProblem : 0);
+	printf("  #Mismatch    : %d\n", g_stats.numMismatch);
+	printf("  #NonMinimal  : %d\n", g_stats.numBadCut);
+	printf("  Time BK      : %.4f seconds\n", g_stats.timeBK);
+	printf("  Time IBFS    : %.4f seconds\n", g_stats.timeIBFS);
+
+	return (g_stats.numMismatch || g_stats.numBadCut) ? 1 : 0;
+}
@@ -1,6 +1,7 @@
 #include "flog.h"
 #include <stdarg.h>
 #include <stdio.h>
+#include <vector>
 #if defined(USE_FLOG_NAMESPACE)
 namespace FLOG {
 #endif
@@ -83,6 +84,28 @@ namespace FLOG {
         return n1;
     }
 
+    int flogTo(std::string *buffer, const char *format, ...)
+    {
+        va_list ap1;
+        va_start(ap1, format);
+        int n1 = vsnprintf(0, 0, format, ap1);
+        va_end(ap1);
+        if (n1 < 0)
+            return n1;
+
+        std::vector<char> text(n1 + 1);
+        va_list ap2;
+        va_start(ap2, format);
+        vsnprintf(text.data(), text.size(), format, ap2);
+        va_end(ap2);
+
+        if (buffer != 0)
+            buffer->append(text.data(), n1);
+        else
+            flog("%s", text.data());
+        return n1;
+    }
+
 #if defined(USE_FLOG_NAMESPACE)
 }
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <string>
 
 //#define USE_FLOG_NAMESPACE
 
@@ -20,6 +21,8 @@ namespace FLOG {
     void setWriteMode();
 
     int flog(const char *format, ...);
+    // Appended to [buffer] if it is NOT null (e.g. in a parallel loop), logged otherwise
+    int flogTo(std::string *buffer, const char *format, ...);
 
 
     class FLogCout